@@ -1,18 +1,24 @@
+
 #ifndef _CLUSTER_H_
 #define _CLUSTER_H_
 
-#include <cstdint>
 #include <atomic>
 
-using namespace std;
+#include "txn/common.h"
+
+// Marks a cluster that Strife's spot step did not pick as special.
+#define CLUSTER_NOT_SPECIAL -1
 
-typedef struct cluster {
-    Value value;
-    struct cluster *parent;
-    uintptr_t address;
-    atomic_int count;
-    int id;
-    Mutex lock;
-} Cluster;
+// A key's slot in StrifeStorage's cluster table: the key's value, plus the
+// key's node in the union-find forest that Strife partitions each batch with.
+// Nodes link to their parents by slot index, so a slot is 24 bytes and the
+// forest lives in the same contiguous array as the values.
+struct Cluster {
+  std::atomic<uint32> parent_;  // Slot of the parent; the slot itself at a root
+  int32 special_;               // Spot id of the special cluster rooted here,
+                                // or CLUSTER_NOT_SPECIAL
+  std::atomic<int> count_;      // Txns fused into the cluster rooted here
+  Value value_;
+};
 
-#endif
+#endif  // _CLUSTER_H_
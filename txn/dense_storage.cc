@@ -0,0 +1,50 @@
+
+#include "txn/dense_storage.h"
+
+DenseStorage::DenseStorage() {}
+
+bool DenseStorage::Read(Key key, Value* result, uint64 txn_unique_id) {
+  DenseRecord* record = table_.Lookup(key);
+  if (record == NULL || !record->exists_)
+    return false;
+  *result = record->value_;
+  return true;
+}
+
+// Write value into the record's slot, then bump its version.
+void DenseStorage::Write(Key key, Value value, uint64 txn_unique_id) {
+  DenseRecord* record = table_.LookupOrCreate(key);
+  record->value_ = value;
+  record->exists_ = true;
+  std::atomic_thread_fence(std::memory_order_release);
+  record->version_++;
+}
+
+uint64 DenseStorage::RecordVersion(Key key) {
+  DenseRecord* record = table_.Lookup(key);
+  if (record == NULL)
+    return 0;
+  return record->version_;
+}
+
+bool DenseStorage::ReadVersioned(Key key, Value* result, uint64* version) {
+  DenseRecord* record = table_.Lookup(key);
+  if (record == NULL) {
+    *version = 0;
+    return false;
+  }
+  *version = record->version_;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (!record->exists_)
+    return false;
+  *result = record->value_;
+  return true;
+}
+
+// Create every key in the dense range with value 0. Versions start at 0,
+// i.e. as if no key had been written yet.
+void DenseStorage::InitStorage() {
+  table_.Init(DENSE_KEY_RANGE);
+}
+
+DenseStorage::~DenseStorage() {}
@@ -0,0 +1,46 @@
+
+#ifndef _DENSE_STORAGE_H_
+#define _DENSE_STORAGE_H_
+
+#include "txn/dense_table.h"
+#include "txn/storage.h"
+
+// A single record slot. The value and its OCC version live in the same
+// cache line, so a read or a write touches exactly one line, and no two
+// records ever share a line (which matters for hot adjacent keys such as the
+// TPCC district records). VLL mode keeps the record's lock state in the same
+// line too, as counts of the queued txns that requested the record.
+struct DenseRecord {
+  Value value_;        // Current value of the record
+  uint64 version_;     // Number of times the record was written (for OCC)
+  uint32 exclusive_requests_;  // VLL: queued txns that write the record
+  uint32 shared_requests_;     // VLL: queued txns that only read it
+  bool exists_;        // False until the record is first written
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// Single-version storage keeping the whole key space in a DenseTable: one
+// contiguous, cache-line-aligned array of records indexed directly by key,
+// with keys outside [0, DENSE_KEY_RANGE) in an overflow hash table.
+class DenseStorage : public Storage {
+ public:
+  DenseStorage();
+
+  virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
+
+  virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
+
+  virtual uint64 RecordVersion(Key key);
+
+  virtual bool ReadVersioned(Key key, Value* result, uint64* version);
+
+  virtual void InitStorage();
+
+  virtual ~DenseStorage();
+
+ private:
+  friend class TxnProcessor;
+
+  DenseTable<DenseRecord> table_;
+};
+
+#endif  // _DENSE_STORAGE_H_
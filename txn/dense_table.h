@@ -0,0 +1,122 @@
+#ifndef _DENSE_TABLE_H_
+#define _DENSE_TABLE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <tr1/unordered_map>
+
+#include "txn/common.h"
+#include "utils/mutex.h"
+
+using std::tr1::unordered_map;
+
+// Number of keys that InitStorage() creates, i.e. keys [0, DENSE_KEY_RANGE)
+// are stored in the dense record array.
+#define DENSE_KEY_RANGE 1000011
+
+#define CACHE_LINE_SIZE 64
+
+// Table of 'Record's keyed by Key, shared by the single-version storages. Keys
+// in [0, size) live in one contiguous, cache-line-aligned array indexed
+// directly by key; other keys fall back to a hash table of individually
+// allocated records, created on first write. Records start out zeroed, so
+// 'Record' must be a plain struct with a 'bool exists_' field.
+template<typename Record>
+class DenseTable {
+ public:
+  DenseTable() : records_(NULL), size_(0) {}
+
+  // Frees the array and every overflow record.
+  ~DenseTable();
+
+  // Allocates the array of records for keys [0, size), each existing and
+  // otherwise zeroed.
+  void Init(Key size);
+
+  // Returns the record for 'key', or NULL if 'key' lies outside the dense
+  // range and has never been written.
+  inline Record* Lookup(Key key) {
+    if (key < size_)
+      return &records_[key];
+    return LookupOverflow(key);
+  }
+
+  // Same as 'Lookup', but creates the record if it does not exist yet.
+  inline Record* LookupOrCreate(Key key) {
+    if (key < size_)
+      return &records_[key];
+    return LookupOrCreateOverflow(key);
+  }
+
+ private:
+  Record* LookupOverflow(Key key);
+  Record* LookupOrCreateOverflow(Key key);
+
+  // Records for keys [0, size_).
+  Record* records_;
+  Key size_;
+
+  // Records for keys outside the dense range, and a lock guarding the table.
+  unordered_map<Key, Record*> overflow_;
+  MutexRW overflow_mutex_;
+
+  // DISALLOW COPY AND ASSIGN
+  DenseTable(const DenseTable&);
+  DenseTable& operator=(const DenseTable&);
+};
+
+template<typename Record>
+DenseTable<Record>::~DenseTable() {
+  free(records_);
+  for (typename unordered_map<Key, Record*>::iterator it = overflow_.begin();
+       it != overflow_.end(); ++it) {
+    free(it->second);
+  }
+  overflow_.clear();
+}
+
+template<typename Record>
+void DenseTable<Record>::Init(Key size) {
+  void* mem;
+  if (posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(Record) * size) != 0)
+    DIE("Could not allocate dense record array.");
+  memset(mem, 0, sizeof(Record) * size);
+  records_ = reinterpret_cast<Record*>(mem);
+  size_ = size;
+
+  for (Key i = 0; i < size_; i++)
+    records_[i].exists_ = true;
+}
+
+template<typename Record>
+Record* DenseTable<Record>::LookupOverflow(Key key) {
+  Record* record = NULL;
+  overflow_mutex_.ReadLock();
+  typename unordered_map<Key, Record*>::iterator it = overflow_.find(key);
+  if (it != overflow_.end())
+    record = it->second;
+  overflow_mutex_.Unlock();
+  return record;
+}
+
+template<typename Record>
+Record* DenseTable<Record>::LookupOrCreateOverflow(Key key) {
+  Record* record = LookupOverflow(key);
+  if (record != NULL)
+    return record;
+
+  overflow_mutex_.WriteLock();
+  Record*& slot = overflow_[key];
+  if (slot == NULL) {
+    void* mem;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(Record)) != 0)
+      DIE("Could not allocate overflow record.");
+    memset(mem, 0, sizeof(Record));
+    slot = reinterpret_cast<Record*>(mem);
+  }
+  record = slot;
+  overflow_mutex_.Unlock();
+  return record;
+}
+
+#endif  // _DENSE_TABLE_H_
@@ -4,34 +4,114 @@
 
 #include "txn/lock_manager.h"
 
-LockManagerA::LockManagerA(deque<Txn*>* ready_txns) {
-  ready_txns_ = ready_txns;
+// Number of LockRequest nodes allocated at once when the pool runs dry.
+#define LOCK_REQUEST_SLAB 1024
+
+// Number of times a thread blocked in ConcurrentLockManager checks whether its
+// request was granted before it parks.
+#define LOCK_WAIT_SPIN_ROUNDS 1024
+
+LockRequestPool::~LockRequestPool() {
+  for (uint32 i = 0; i < request_slabs_.size(); i++)
+    delete[] request_slabs_[i];
 }
 
-bool LockManagerA::WriteLock(Txn* txn, const Key& key) {
-  //
-  // Implement this method!
-
-  // vector<Txn*> owners;
-  // LockMode status = LockManagerA::Status(key, &owners);
-  LockRequest *new_request = new LockRequest(EXCLUSIVE, txn);
-  
-  deque<LockRequest> *lock_requests;
-  if (lock_table_[key])
-		lock_requests = lock_table_[key];
+LockRequest* LockRequestPool::Enqueue(LockQueue* queue, Txn* txn,
+                                       LockMode mode) {
+  if (free_requests_ == NULL) {
+    LockRequest* slab = new LockRequest[LOCK_REQUEST_SLAB];
+    request_slabs_.push_back(slab);
+    for (int i = 0; i < LOCK_REQUEST_SLAB; i++) {
+      slab[i].next_ = free_requests_;
+      free_requests_ = &slab[i];
+    }
+  }
+  LockRequest* request = free_requests_;
+  free_requests_ = request->next_;
+
+  request->txn_ = txn;
+  request->mode_ = mode;
+  request->granted_ = false;
+  request->waiter_ = NULL;
+  request->prev_ = queue->tail_;
+  request->next_ = NULL;
+  if (queue->tail_ != NULL)
+    queue->tail_->next_ = request;
+  else
+    queue->head_ = request;
+  queue->tail_ = request;
+  return request;
+}
+
+LockRequest* LockRequestPool::Find(LockQueue* queue, Txn* txn) {
+  for (LockRequest* r = queue->head_; r != NULL; r = r->next_) {
+    if (r->txn_ == txn)
+      return r;
+  }
+  return NULL;
+}
+
+void LockRequestPool::Remove(LockQueue* queue, LockRequest* request) {
+  if (request->prev_ != NULL)
+    request->prev_->next_ = request->next_;
+  else
+    queue->head_ = request->next_;
+  if (request->next_ != NULL)
+    request->next_->prev_ = request->prev_;
   else
-		lock_requests = new std::deque<LockRequest>;
-		
-	LockMode status = lock_requests->size() > 0 ? EXCLUSIVE : UNLOCKED;
+    queue->tail_ = request->prev_;
+
+  request->next_ = free_requests_;
+  free_requests_ = request;
+}
+
+void LockManager::Grant(LockQueue* queue, bool shared) {
+  LockRequest* r = queue->head_;
+  if (r == NULL)
+    return;
+  if (!shared || r->mode_ == EXCLUSIVE) {
+    if (!r->granted_) {
+      r->granted_ = true;
+      WaitSatisfied(r->txn_);
+    }
+    return;
+  }
+  for (; r != NULL && r->mode_ == SHARED; r = r->next_) {
+    if (!r->granted_) {
+      r->granted_ = true;
+      WaitSatisfied(r->txn_);
+    }
+  }
+}
+
+void LockManager::WaitSatisfied(Txn* txn) {
+  unordered_map<Txn*, int>::iterator it = txn_waits_.find(txn);
+  if (--it->second == 0) {
+    txn_waits_.erase(it);
+    ready_txns_->push_back(txn);
+  }
+}
 
-  lock_requests->push_back(*new_request);
-  lock_table_[key] = lock_requests;
+void LockManager::WaitCancelled(Txn* txn) {
+  unordered_map<Txn*, int>::iterator it = txn_waits_.find(txn);
+  if (it != txn_waits_.end() && --it->second <= 0)
+    txn_waits_.erase(it);
+}
+
+LockManagerA::LockManagerA(deque<Txn*>* ready_txns) {
+  ready_txns_ = ready_txns;
+}
 
-  if (status != UNLOCKED) {
-		txn_waits_[txn] += 1;
-		return false;
+bool LockManagerA::WriteLock(Txn* txn, const Key& key) {
+  LockQueue* queue = &lock_table_[key];
+  bool granted = (queue->head_ == NULL);
+  LockRequest* request = requests_.Enqueue(queue, txn, EXCLUSIVE);
+  if (granted) {
+    request->granted_ = true;
+    return true;
   }
-  return true;
+  txn_waits_[txn]++;
+  return false;
 }
 
 bool LockManagerA::ReadLock(Txn* txn, const Key& key) {
@@ -41,73 +121,27 @@ bool LockManagerA::ReadLock(Txn* txn, const Key& key) {
 }
 
 void LockManagerA::Release(Txn* txn, const Key& key) {
-  //
-  // Implement this method!
-
-  if (lock_table_[key]) {
-	if (lock_table_[key]->size() > 0) {
-		deque<LockRequest> *lock_requests = lock_table_[key];
-		// first request is the one being released
-		if (lock_requests->at(0).txn_ == txn) {
-			lock_requests->pop_front();
-
-			if (lock_requests->size() > 0) {
-				LockRequest *next_req = &(lock_requests->at(0));
-				txn_waits_[next_req->txn_] -= 1;
-				if (txn_waits_[next_req->txn_] == 0)
-					ready_txns_->push_back(next_req->txn_);
-			}
-		} else { // removing from somewhere in the middle of the deque
-			deque<LockRequest> *new_deque = new deque<LockRequest>;
-			for (uint index=0; index < lock_requests->size(); index++) {
-				if (lock_requests->at(index).txn_ != txn)
-					new_deque->push_back(lock_requests->at(index));
-			}
-			lock_table_[key] = new_deque;
-			txn_waits_[txn] -= 1;
-		}
-	}
-  }
+  LockQueue* queue = &lock_table_[key];
+  LockRequest* request = LockRequestPool::Find(queue, txn);
+  if (request == NULL)
+    return;
 
-//  bool was_first = false;
-//  if (lock_table_[key]) {
-//	// remove txn from deque
-//	if (lock_table_[key]->size() > 0) {
-//		was_first = lock_table_[key]->at(0).txn_ == txn;
-//		std::deque<LockRequest> *new_deque = new std::deque<LockRequest>;
-//		for (uint index=0; index < lock_table_[key]->size(); index++) {
-//			if (lock_table_[key]->at(index).txn_ != txn) {
-//				new_deque->push_back(lock_table_[key]->at(index));
-//			}
-//		}
-//		lock_table_[key] = new_deque;
-//	}
-//	// grant next request in queue if txn prev held it; if txn has now acquired all locks, add to ready_txns_
-//	// decrement number of locks txn is waiting on
-//	if (was_first && lock_table_[key]->size() > 0) {
-//		Txn *next_txn = lock_table_[key]->at(0).txn_;
-//		txn_waits_[next_txn] -= 1;
-//		// if num waits is 0 then txn is ready
-//		if (txn_waits_[next_txn] == 0) {
-//			ready_txns_->push_back(next_txn);
-//		}
-//	}
-//  }
-  return;
+  // Cancelling a request that was still waiting.
+  if (!request->granted_)
+    WaitCancelled(txn);
+
+  // Unlink in place and hand the lock to the next request in line.
+  requests_.Remove(queue, request);
+  Grant(queue, false);
 }
 
 // NOTE: The owners input vector is NOT assumed to be empty.
 LockMode LockManagerA::Status(const Key& key, vector<Txn*>* owners) {
-  //
-  // Implement this method!
-  if (owners)
-		owners->clear();
-  else
-		owners = new vector<Txn*>;
-  std::deque<LockRequest>* lock_requests = lock_table_[key];
-  if (!lock_requests || lock_requests->size() == 0)
-		return UNLOCKED;
-  owners->push_back(lock_requests->at(0).txn_);
+  owners->clear();
+  unordered_map<Key, LockQueue>::iterator it = lock_table_.find(key);
+  if (it == lock_table_.end() || it->second.head_ == NULL)
+    return UNLOCKED;
+  owners->push_back(it->second.head_->txn_);
   return EXCLUSIVE;
 }
 
@@ -116,290 +150,191 @@ LockManagerB::LockManagerB(deque<Txn*>* ready_txns) {
 }
 
 bool LockManagerB::WriteLock(Txn* txn, const Key& key) {
-  //
-  // Implement this method!
-  // vector<Txn*> owners;
-  // LockMode status = LockManagerB::Status(key, &owners);
-  LockRequest *new_request = new LockRequest(EXCLUSIVE, txn);
-
-  deque<LockRequest> *lock_requests;
-  if (lock_table_[key])
-		lock_requests = lock_table_[key];
-  else
-		lock_requests = new std::deque<LockRequest>;
-		
-	LockMode status = lock_requests->size() > 0 ? EXCLUSIVE : UNLOCKED;
-
-  lock_requests->push_back(*new_request);
-  lock_table_[key] = lock_requests;
-
-  if (status != UNLOCKED) {
-		txn_waits_[txn] += 1;
-		return false;
+  LockQueue* queue = &lock_table_[key];
+  bool granted = (queue->head_ == NULL);
+  LockRequest* request = requests_.Enqueue(queue, txn, EXCLUSIVE);
+  if (granted) {
+    request->granted_ = true;
+    return true;
   }
-  return true;
+  txn_waits_[txn]++;
+  return false;
 }
 
 bool LockManagerB::ReadLock(Txn* txn, const Key& key) {
-  //
-  // Implement this method!
-  LockRequest *new_request = new LockRequest(SHARED, txn);
-  deque<LockRequest> *lock_requests;
-  if (lock_table_[key])
-		lock_requests = lock_table_[key];
-  else
-		lock_requests = new std::deque<LockRequest>;
+  LockQueue* queue = &lock_table_[key];
 
-  lock_requests->push_back(*new_request);
-  lock_table_[key] = lock_requests;
+  // The read lock is granted iff no EXCLUSIVE request is queued for this key.
+  bool granted = true;
+  for (LockRequest* r = queue->head_; r != NULL; r = r->next_) {
+    if (r->mode_ == EXCLUSIVE) {
+      granted = false;
+      break;
+    }
+  }
 
-  // if there is any exclusive lock for this key, the read lock will be false; true otherwise
-  for (uint index=0; index<lock_requests->size(); index++) {
-		if (lock_requests->at(index).mode_ == EXCLUSIVE) {
-			txn_waits_[txn] += 1;
-			return false;
-		}
+  LockRequest* request = requests_.Enqueue(queue, txn, SHARED);
+  if (granted) {
+    request->granted_ = true;
+    return true;
   }
-  return true;
+  txn_waits_[txn]++;
+  return false;
 }
 
 void LockManagerB::Release(Txn* txn, const Key& key) {
-  //
-  // Implement this method!
-  
-  if (lock_table_[key]) {
-  	if (lock_table_[key]->size() > 0) {
-  		
-  		deque<LockRequest> *lock_requests = lock_table_[key];
-  		
-  		// if first request is the one being released
-  		if (lock_requests->at(0).txn_ == txn) {
-  			LockMode prev_mode = lock_requests->at(0).mode_;
-  			lock_requests->pop_front();
-  			
-  			if (lock_requests->size() > 0) {
-  				if (prev_mode == EXCLUSIVE) {
-  					if (lock_requests->at(0).mode_ == EXCLUSIVE) {
-  						LockRequest *next_req = &(lock_requests->at(0));
-  						txn_waits_[next_req->txn_] -= 1;
-  						if (txn_waits_[next_req->txn_] == 0)
-  							ready_txns_->push_back(next_req->txn_);
-  					} else if (lock_requests->at(0).mode_ == SHARED) {
-  						for (uint index=0; index<lock_requests->size(); index++) {
-  							LockRequest *curr_request = &(lock_requests->at(index));
-  							if (curr_request->mode_ == EXCLUSIVE)
-  								return;
-  							else if (curr_request->mode_ == SHARED) {
-  								txn_waits_[curr_request->txn_] -= 1;
-  								if (txn_waits_[curr_request->txn_] == 0)
-  									ready_txns_->push_back(curr_request->txn_);
-  							}
-  						}
-  					}
-  				} else if (prev_mode == SHARED) {
-  					if (lock_requests->at(0).mode_ == EXCLUSIVE) {
-  						LockRequest *next_req = &(lock_requests->at(0));
-  						txn_waits_[next_req->txn_] -= 1;
-  						if (txn_waits_[next_req->txn_] == 0)
-  							ready_txns_->push_back(next_req->txn_);
-  					}
-  				}
-  			}
-  		} else { // release key is somewhere in middle of deque
-  			deque<LockRequest> *new_deque = new deque<LockRequest>;
-  			LockMode prev_mode = UNLOCKED;
-  			
-  			for (uint index=0; index<lock_requests->size(); index++) {
-  				LockRequest *curr_request = &(lock_requests->at(index));
-  				if (curr_request->txn_ != txn)
-  					new_deque->push_back((*curr_request));
-  				else
-  					prev_mode = curr_request->mode_;
-  			}
-  			vector<Txn*> prev_owners;
-			  Status(key, &prev_owners);
-			  // construct map of previous owners
-			  unordered_map<Txn*, bool> previous_owners;
-			  for (size_t i =0; i<prev_owners.size(); i++)
-					previous_owners[prev_owners[i]] = true;
-				lock_table_[key] = new_deque;
-				
-				if (prev_mode == EXCLUSIVE) {
-					txn_waits_[txn] -= 1;
-					for (uint index=0; index<new_deque->size(); index++) {
-						LockRequest *curr_request = &(new_deque->at(index));
-						if (curr_request->mode_ == EXCLUSIVE)
-							return;
-						if (!previous_owners[curr_request->txn_]) {
-							txn_waits_[curr_request->txn_] -= 1;
-							if (txn_waits_[curr_request->txn_] == 0)
-								ready_txns_->push_back(curr_request->txn_);
-						}
-					}
-				} else if (prev_mode == SHARED) {
-					if (!previous_owners[txn])
-						txn_waits_[txn] -= 1;
-				}
-  		}
-  	}
-  }
-  
-  
-  
-  
-  
-  // vector<Txn*> prev_owners;
-  // LockManagerB::Status(key, &prev_owners);
-  // // construct map of previous owners
-  // unordered_map<Txn*, bool> previous_owners;
-  // for (size_t i =0; i<prev_owners.size(); i++)
-		// previous_owners[prev_owners[i]] = true;
-	
-  // LockMode prev_mode = UNLOCKED;
-  // if (lock_table_[key]) {
-		// if (lock_table_[key]->size() > 0) {
-			
-		// 	deque<LockRequest> *lock_requests = lock_table_[key];
-		// 	// if key to remove is first
-		// 	if (lock_requests->at(0).txn_ == txn) {
-		// 		prev_mode = lock_requests->at(0).mode_;
-		// 		lock_requests->pop_front();
-				
-		// 		if (lock_requests->size() > 0) {
-		// 			LockRequest *next_req = &(lock_table_[key]->at(0));
-		// 			if (prev_mode == EXCLUSIVE) {
-		// 				if (next_req->mode_ == EXCLUSIVE) {
-		// 					txn_waits_[next_req->txn_] -= 1;
-		// 					if (txn_waits_[next_req->txn_] == 0)
-		// 						ready_txns_->push_back(next_req->txn_);
-		// 				} else if (next_req->mode_ == SHARED) {
-		// 					for (uint index=0; index < lock_requests->size(); index++) {
-		// 						LockRequest *curr_request = &(lock_requests->at(index));
-		// 						if (curr_request->mode_ == EXCLUSIVE)
-		// 							return;
-		// 						txn_waits_[curr_request->txn_] -= 1;
-		// 						if (txn_waits_[curr_request->txn_] == 0)
-		// 							ready_txns_->push_back(curr_request->txn_);
-		// 					}
-		// 				}
-		// 			} else if (prev_mode == SHARED) {
-		// 				if (next_req->mode_ == EXCLUSIVE) {
-		// 					txn_waits_[next_req->txn_] -= 1;
-		// 					if (txn_waits_[next_req->txn_] <= 0)
-		// 						ready_txns_->push_back(next_req->txn_);
-		// 				}
-		// 			}
-		// 		}
-		// 		return;
-		// 	}
-			
-			
-			
-			
-		// 	std::deque<LockRequest> *new_deque = new std::deque<LockRequest>;
-		// 	std::deque<LockRequest> *curr_deque = lock_table_[key];
-
-		// 	for (uint index=0; index<curr_deque->size(); index++) {
-		// 		if (curr_deque->at(index).txn_ != txn)
-		// 			new_deque->push_back(curr_deque->at(index));
-		// 		else
-		// 			prev_mode = curr_deque->at(index).mode_;
-		// 	}
-		// 	lock_table_[key] = new_deque;
-			
-		// 	if (prev_mode == EXCLUSIVE) {
-				
-		// 		for (uint index = 0; index < lock_table_[key]->size(); index++) {
-		// 			LockRequest *curr_request = &(lock_table_[key]->at(index));
-		// 			if (curr_request->mode_ == EXCLUSIVE)
-		// 				return;
-		// 			else if (curr_request->mode_ == SHARED) {
-		// 				if (!previous_owners[curr_request->txn_]) {
-		// 					txn_waits_[curr_request->txn_] -= 1;
-		// 					if (txn_waits_[curr_request->txn_])
-		// 						ready_txns_->push_back(curr_request->txn_);
-		// 				}
-		// 			}
-		// 		}
-		// 	}
-		// }
-		// // if (lock_table_[key]->size() > 0) {
-		// // 	LockRequest *next_req = &(lock_table_[key]->at(0));
-		// // 	if (prev_mode == EXCLUSIVE) {
-				
-		// // 		for (uint index = 0; index < lock_table_[key]->size(); index++) {
-		// // 			LockRequest *curr_request = &(lock_table_[key]->at(index));
-		// // 			if (curr_request->mode_ == EXCLUSIVE)
-		// // 				return;
-		// // 			else if (curr_request->mode_ == SHARED) {
-		// // 				if (!previous_owners[curr_request->txn_]) {
-		// // 					txn_waits_[curr_request->txn_] -= 1;
-		// // 					if (txn_waits_[curr_request->txn_])
-		// // 						ready_txns_->push_back(curr_request->txn_);
-		// // 				}
-		// // 			}
-		// // 		}
-		// // 	}
-				
-				
-				
-				
-		// // 	// grant to all successive shared or next exclusive
-		// // 		if (next_req->mode_ == EXCLUSIVE && !previous_owners[next_req->txn_]) {
-		// // 			txn_waits_[next_req->txn_] -= 1;
-		// // 			if (txn_waits_[next_req->txn_] == 0) {
-		// // 				ready_txns_->push_back(next_req->txn_);
-		// // 			}
-		// // 		} else if (next_req->mode_ == SHARED) {
-		// // 			uint index = 0;
-		// // 			while (index < lock_table_[key]->size()) {
-		// // 				next_req = &(lock_table_[key]->at(index));
-		// // 				if (next_req->mode_ == EXCLUSIVE)
-		// // 					break;
-		// // 				else if (next_req->mode_ == SHARED && !previous_owners[next_req->txn_]) {
-		// // 					txn_waits_[next_req->txn_] -= 1;
-		// // 					if (txn_waits_[next_req->txn_]==0)
-		// // 						ready_txns_->push_back(next_req->txn_);
-		// // 				}
-		// // 				index++;
-		// // 			}
-		// // 		}
-		// // 	} else if (prev_mode == SHARED) {
-		// // 	// only grant next request if its exclusive
-		// // 		if (next_req->mode_ == EXCLUSIVE) {
-		// // 			txn_waits_[next_req->txn_] -= 1;
-		// // 			if (txn_waits_[next_req->txn_]==0)
-		// // 				ready_txns_->push_back(next_req->txn_);
-		// // 		}
-		// // 	}
-		// // }
-  // }
+  LockQueue* queue = &lock_table_[key];
+  LockRequest* request = LockRequestPool::Find(queue, txn);
+  if (request == NULL)
+    return;
+
+  // Cancelling a request that was still waiting.
+  if (!request->granted_)
+    WaitCancelled(txn);
+
+  // Unlink in place, then grant the lock to every request now at the front:
+  // the next EXCLUSIVE request, or the run of SHARED requests.
+  requests_.Remove(queue, request);
+  Grant(queue, true);
 }
 
 // NOTE: The owners input vector is NOT assumed to be empty.
 LockMode LockManagerB::Status(const Key& key, vector<Txn*>* owners) {
-  //
-  // Implement this method!
-  if (owners)
-		owners->clear();
-  else
-		owners = new vector<Txn*>;
-  std::deque<LockRequest> *lock_requests = lock_table_[key];
-  if (!lock_requests || lock_requests->size() == 0) {
-		return UNLOCKED;
+  owners->clear();
+  unordered_map<Key, LockQueue>::iterator it = lock_table_.find(key);
+  if (it == lock_table_.end() || it->second.head_ == NULL)
+    return UNLOCKED;
+  LockRequest* r = it->second.head_;
+  if (r->mode_ == EXCLUSIVE) {
+    owners->push_back(r->txn_);
+    return EXCLUSIVE;
+  }
+  for (; r != NULL && r->mode_ == SHARED; r = r->next_)
+    owners->push_back(r->txn_);
+  return SHARED;
+}
+
+ConcurrentLockManager::ConcurrentLockManager(int partitions)
+    : num_partitions_(partitions) {
+  partitions_ = new Partition[num_partitions_];
+}
+
+ConcurrentLockManager::~ConcurrentLockManager() {
+  delete[] partitions_;
+}
+
+bool ConcurrentLockManager::Grantable(const LockQueue& queue, LockMode mode) {
+  if (queue.tail_ == NULL)
+    return true;
+  return mode == SHARED && queue.tail_->mode_ == SHARED &&
+         queue.tail_->granted_;
+}
+
+void ConcurrentLockManager::ReadLock(Txn* txn, const Key& key) {
+  Lock(txn, key, SHARED);
+}
+
+void ConcurrentLockManager::WriteLock(Txn* txn, const Key& key) {
+  Lock(txn, key, EXCLUSIVE);
+}
+
+bool ConcurrentLockManager::TryReadLock(Txn* txn, const Key& key) {
+  return TryLock(txn, key, SHARED);
+}
+
+bool ConcurrentLockManager::TryWriteLock(Txn* txn, const Key& key) {
+  return TryLock(txn, key, EXCLUSIVE);
+}
+
+void ConcurrentLockManager::Lock(Txn* txn, const Key& key, LockMode mode) {
+  Partition* partition = PartitionFor(key);
+  partition->latch_.Lock();
+  LockQueue* queue = &partition->lock_table_[key];
+  bool granted = Grantable(*queue, mode);
+  LockRequest* request = partition->requests_.Enqueue(queue, txn, mode);
+  if (granted) {
+    request->granted_ = true;
+    partition->latch_.Unlock();
+    return;
+  }
+
+  // Not granted: Release() will signal 'waiter' once it is.
+  LockWaiter waiter(&partition->latch_);
+  request->waiter_ = &waiter;
+  partition->latch_.Unlock();
+
+  // Handoffs are usually quick, so spin a little before parking.
+  for (int i = 0; i < LOCK_WAIT_SPIN_ROUNDS; i++) {
+    if (waiter.granted_.load())
+      return;
+  }
+  waiter.cv_.WaitWhileTrue(&waiter.waiting_);
+}
+
+bool ConcurrentLockManager::TryLock(Txn* txn, const Key& key, LockMode mode) {
+  Partition* partition = PartitionFor(key);
+  partition->latch_.Lock();
+  LockQueue* queue = &partition->lock_table_[key];
+  bool granted = Grantable(*queue, mode);
+  if (granted)
+    partition->requests_.Enqueue(queue, txn, mode)->granted_ = true;
+  partition->latch_.Unlock();
+  return granted;
+}
+
+void ConcurrentLockManager::Release(Txn* txn, const Key& key) {
+  Partition* partition = PartitionFor(key);
+  partition->latch_.Lock();
+  unordered_map<Key, LockQueue>::iterator it =
+      partition->lock_table_.find(key);
+  if (it == partition->lock_table_.end()) {
+    partition->latch_.Unlock();
+    return;
   }
-  LockMode first_lock = lock_requests->at(0).mode_;
-  if (first_lock == EXCLUSIVE) {
-		owners->push_back(lock_requests->at(0).txn_);
-		return EXCLUSIVE;
+  LockQueue* queue = &it->second;
+  LockRequest* request = LockRequestPool::Find(queue, txn);
+  if (request != NULL)
+    partition->requests_.Remove(queue, request);
+  if (queue->head_ == NULL) {
+    partition->lock_table_.erase(it);
+    partition->latch_.Unlock();
+    return;
   }
-  for (uint index=0; index < lock_requests->size(); index++) {
-		LockRequest req = lock_requests->at(index);
-		if (req.mode_ == EXCLUSIVE)
-			return SHARED;
-		else {
-			owners->push_back(req.txn_);
-		}
+
+  // Grant the lock to the requests now at the front: the next EXCLUSIVE one,
+  // or the run of SHARED ones, and wake their threads. The waiter may return
+  // as soon as it sees 'granted_', so that is the last thing touched; a
+  // parked waiter needs the latch to return, so it is signalled under it.
+  for (LockRequest* r = queue->head_; r != NULL; r = r->next_) {
+    if (r != queue->head_ && (r->mode_ == EXCLUSIVE ||
+                              queue->head_->mode_ == EXCLUSIVE))
+      break;
+    if (r->granted_)
+      continue;
+    r->granted_ = true;
+    LockWaiter* waiter = r->waiter_;
+    r->waiter_ = NULL;
+    waiter->waiting_ = false;
+    waiter->cv_.SignalHeld();
+    waiter->granted_.store(true);
   }
-  return SHARED;
+  partition->latch_.Unlock();
+}
+
+LockMode ConcurrentLockManager::Status(const Key& key, vector<Txn*>* owners) {
+  owners->clear();
+  Partition* partition = PartitionFor(key);
+  partition->latch_.Lock();
+  LockMode mode = UNLOCKED;
+  unordered_map<Key, LockQueue>::iterator it =
+      partition->lock_table_.find(key);
+  if (it != partition->lock_table_.end()) {
+    for (LockRequest* r = it->second.head_; r != NULL && r->granted_;
+         r = r->next_) {
+      owners->push_back(r->txn_);
+      mode = r->mode_;
+    }
+  }
+  partition->latch_.Unlock();
+  return mode;
 }
@@ -5,11 +5,14 @@
 #define _LOCK_MANAGER_H_
 
 #include <tr1/unordered_map>
+#include <atomic>
 #include <deque>
 #include <map>
 #include <vector>
 
 #include "txn/common.h"
+#include "utils/condition.h"
+#include "utils/mutex.h"
 
 using std::map;
 using std::deque;
@@ -26,6 +29,61 @@ enum LockMode {
   EXCLUSIVE = 2,
 };
 
+// A thread blocked in ConcurrentLockManager until its request is granted. It
+// lives on that thread's stack; its Condition uses the latch of the request's
+// partition, under which Release() signals it.
+struct LockWaiter {
+  explicit LockWaiter(Mutex* latch) : waiting_(true), granted_(false),
+                                      cv_(latch) {}
+  bool waiting_;               // Guarded by the partition latch.
+  std::atomic<bool> granted_;  // Set last, for the spin before parking.
+  Condition cv_;
+};
+
+// A request for a lock on some key, linked into that key's LockQueue. The
+// queue is a doubly-linked list, so a request anywhere in it is unlinked in
+// place.
+struct LockRequest {
+  Txn* txn_;           // Pointer to txn requesting the lock.
+  LockMode mode_;      // Read or write lock request.
+  bool granted_;       // True once the request holds the lock.
+  LockWaiter* waiter_; // Thread blocked on the request (ConcurrentLockManager
+                       // only), or NULL.
+  LockRequest* prev_;  // Neighbours in the key's queue (or the free list).
+  LockRequest* next_;
+};
+
+struct LockQueue {
+  LockQueue() : head_(NULL), tail_(NULL) {}
+  LockRequest* head_;
+  LockRequest* tail_;
+};
+
+// Free list of LockRequest nodes, carved out of slabs of LOCK_REQUEST_SLAB
+// nodes, so that queueing a request never allocates once the pool has warmed
+// up. Not thread-safe.
+class LockRequestPool {
+ public:
+  LockRequestPool() : free_requests_(NULL) {}
+
+  // Frees every slab, and with them every node.
+  ~LockRequestPool();
+
+  // Appends a request by 'txn' in 'mode' to 'queue', using a pooled node.
+  LockRequest* Enqueue(LockQueue* queue, Txn* txn, LockMode mode);
+
+  // Returns the request by 'txn' in 'queue', or NULL if there is none.
+  static LockRequest* Find(LockQueue* queue, Txn* txn);
+
+  // Unlinks 'request' from 'queue' and returns its node to the pool.
+  void Remove(LockQueue* queue, LockRequest* request);
+
+ private:
+  // Free LockRequest nodes, and all node slabs allocated so far.
+  LockRequest* free_requests_;
+  vector<LockRequest*> request_slabs_;
+};
+
 class LockManager {
  public:
   virtual ~LockManager() {}
@@ -67,16 +125,16 @@ class LockManager {
 
  protected:
   // The LockManager's lock table tracks all lock requests. For a given key, if
-  // 'lock_table_' contains a nonempty deque, then the item with that key is
+  // 'lock_table_' contains a nonempty queue, then the item with that key is
   // locked and either:
   //
-  //  (a) first element in the deque specifies the owner if that item is a
+  //  (a) first element in the queue specifies the owner if that item is a
   //      request for an EXCLUSIVE lock, or
   //
   //  (b) a SHARED lock is held by all elements of the longest prefix of the
-  //      deque containing only SHARED lock requests.
+  //      queue containing only SHARED lock requests.
   //
-  // For example, if lock_table_["key1"] points to a deque containing
+  // For example, if lock_table_["key1"] contains
   //
   //    (&Txn1, SHARED), (&Txn2, SHARED), (&Txn3, EXCLUSIVE), (&Txn4, SHARED)
   //
@@ -86,27 +144,37 @@ class LockManager {
   // cannot acquire a lock until after Txn3 has released its lock, so it cannot
   // share the lock with Txn1 and Txn2.)
   //
-  // As a second example, if lock_table_["key1"] points to a deque containing
+  // As a second example, if lock_table_["key1"] contains
   //
   //    (&Txn1, EXCLUSIVE), (&Txn2, SHARED), (&Txn3, SHARED), (Txn4, EXCLUSIVE)
   //
   // then Txn1 currently holds an EXCLUSIVE lock on "key1". When Txn1 releases
   // its lock, Txn2 and Txn3 will simultaneously acquire SHARED locks on "key1".
-  struct LockRequest {
-    LockRequest(LockMode m, Txn* t) : txn_(t), mode_(m) {}
-    Txn* txn_;       // Pointer to txn requesting the lock.
-    LockMode mode_;  // Specifies whether this is a read or write lock request.
-  };
-  unordered_map<Key, deque<LockRequest>*> lock_table_;
+  //
+  // Each queue is stored inline in the table. Request nodes come from
+  // 'requests_' and are recycled on release.
+  unordered_map<Key, LockQueue> lock_table_;
+  LockRequestPool requests_;
+
+  // Marks as granted all requests at the front of 'queue' that now hold the
+  // lock: the first request, plus (if 'shared') the run of SHARED requests
+  // it starts. Txns that thereby acquire all their locks become ready.
+  void Grant(LockQueue* queue, bool shared);
+
+  // Records that 'txn' acquired a lock it was waiting on, appending it to
+  // 'ready_txns_' if that was the last one.
+  void WaitSatisfied(Txn* txn);
+
+  // Records that 'txn' cancelled a request it was waiting on.
+  void WaitCancelled(Txn* txn);
 
   // Queue of pointers to transactions that:
   //  (a) were previously blocked on acquiring at least one lock, and
   //  (b) have now acquired all locks that they have requested.
   deque<Txn*>* ready_txns_;
 
-  // Tracks all txns still waiting on acquiring at least one lock. Entries in
-  // 'txn_waits_' are invalided by any call to Release() with the entry's
-  // txn.
+  // Tracks all txns still waiting on acquiring at least one lock. Entries are
+  // erased as soon as the txn is no longer waiting.
   unordered_map<Txn*, int> txn_waits_;
 };
 
@@ -134,5 +202,72 @@ class LockManagerB : public LockManager {
   virtual LockMode Status(const Key& key, vector<Txn*>* owners);
 };
 
+// Number of independently latched partitions of a ConcurrentLockManager's lock
+// table.
+#define LOCK_PARTITIONS 1024
+
+// Thread-safe lock manager implementing both shared and exclusive locks. The
+// lock table is split into partitions by key, each guarded by its own latch,
+// so any number of worker threads can acquire and release their own locks at
+// once. Lock semantics (FIFO request queue per key, shared prefix) are the
+// same as LockManagerB's.
+//
+// Unlike the LockManager interface, ReadLock and WriteLock block the calling
+// thread until the lock is granted, so there is no ready queue. To stay free
+// of deadlocks, each txn must request its locks in increasing key order.
+class ConcurrentLockManager {
+ public:
+  explicit ConcurrentLockManager(int partitions = LOCK_PARTITIONS);
+  ~ConcurrentLockManager();
+
+  // Blocks until 'txn' holds a read (or write) lock on 'key'.
+  //
+  // Requires: 'txn' holds no lock on 'key' or any larger key.
+  void ReadLock(Txn* txn, const Key& key);
+  void WriteLock(Txn* txn, const Key& key);
+
+  // Grants a read (or write) lock on 'key' to 'txn' and returns true if it can
+  // be granted immediately, else returns false without enqueueing a request.
+  bool TryReadLock(Txn* txn, const Key& key);
+  bool TryWriteLock(Txn* txn, const Key& key);
+
+  // Releases the lock held by 'txn' on 'key', and wakes up the txn(s) whose
+  // requests are granted as a result.
+  //
+  // Requires: 'txn' holds a lock on 'key'.
+  void Release(Txn* txn, const Key& key);
+
+  // Same as LockManager::Status.
+  LockMode Status(const Key& key, vector<Txn*>* owners);
+
+ private:
+  // One partition of the lock table. Its queues are emptied of requests by
+  // Release(), and erased along with the last one, so the table only holds
+  // keys that are currently locked or requested.
+  struct Partition {
+    Mutex latch_;
+    unordered_map<Key, LockQueue> lock_table_;
+    LockRequestPool requests_;
+    // Keep neighbouring partitions' latches off each other's cache lines.
+    char pad_[64];
+  };
+
+  inline Partition* PartitionFor(const Key& key) {
+    // Spread consecutive keys (e.g. hot TPCC district records) apart.
+    return &partitions_[(key * 0x9E3779B97F4A7C15ULL >> 32) % num_partitions_];
+  }
+
+  // Returns true if a new request in 'mode' at the back of 'queue' would be
+  // granted at once. Since requests are granted in order, a SHARED one is iff
+  // the last request is a granted SHARED one.
+  static bool Grantable(const LockQueue& queue, LockMode mode);
+
+  void Lock(Txn* txn, const Key& key, LockMode mode);
+  bool TryLock(Txn* txn, const Key& key, LockMode mode);
+
+  Partition* partitions_;
+  int num_partitions_;
+};
+
 #endif  // _LOCK_MANAGER_H_
 
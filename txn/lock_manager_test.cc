@@ -2,9 +2,14 @@
 
 #include "txn/lock_manager.h"
 
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
 #include <set>
 #include <string>
 
+#include "txn/txn_processor.h"
+#include "txn/txn_types.h"
 #include "utils/testing.h"
 
 using std::set;
@@ -186,10 +191,286 @@ TEST(LockManagerB_LocksReleasedOutOfOrder) {
   END;
 }
 
+TEST(ConcurrentLockManager_SimpleLocking) {
+  ConcurrentLockManager lm;
+  vector<Txn*> owners;
+
+  Txn* t1 = reinterpret_cast<Txn*>(1);
+  Txn* t2 = reinterpret_cast<Txn*>(2);
+  Txn* t3 = reinterpret_cast<Txn*>(3);
+
+  // Txn 1 acquires read lock.
+  EXPECT_TRUE(lm.TryReadLock(t1, 101));
+  EXPECT_EQ(SHARED, lm.Status(101, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t1, owners[0]);
+
+  // Txn 2 cannot get a write lock, and leaves no request behind.
+  EXPECT_FALSE(lm.TryWriteLock(t2, 101));
+
+  // Txn 3 shares the read lock.
+  EXPECT_TRUE(lm.TryReadLock(t3, 101));
+  EXPECT_EQ(SHARED, lm.Status(101, &owners));
+  EXPECT_EQ(2, owners.size());
+  EXPECT_EQ(t1, owners[0]);
+  EXPECT_EQ(t3, owners[1]);
+
+  // Once both readers are gone, Txn 2 gets its write lock.
+  lm.Release(t1, 101);
+  lm.Release(t3, 101);
+  EXPECT_EQ(UNLOCKED, lm.Status(101, &owners));
+  EXPECT_TRUE(lm.TryWriteLock(t2, 101));
+  EXPECT_EQ(EXCLUSIVE, lm.Status(101, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t2, owners[0]);
+  EXPECT_FALSE(lm.TryReadLock(t1, 101));
+
+  END;
+}
+
+struct BlockedTxn {
+  ConcurrentLockManager* lm;
+  Txn* txn;
+  LockMode mode;
+  volatile bool granted;
+};
+
+void* LockAndReport(void* arg) {
+  BlockedTxn* w = reinterpret_cast<BlockedTxn*>(arg);
+  if (w->mode == SHARED)
+    w->lm->ReadLock(w->txn, 101);
+  else
+    w->lm->WriteLock(w->txn, 101);
+  w->granted = true;
+  return NULL;
+}
+
+// Seconds of CPU time that this process has used so far.
+double CpuTime() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+TEST(ConcurrentLockManager_BlockingHandoff) {
+  ConcurrentLockManager lm;
+  vector<Txn*> owners;
+
+  Txn* t1 = reinterpret_cast<Txn*>(1);
+  Txn* t2 = reinterpret_cast<Txn*>(2);
+  Txn* t3 = reinterpret_cast<Txn*>(3);
+
+  // Txn 1 acquires write lock without waiting.
+  lm.WriteLock(t1, 101);
+
+  // Txns 2 and 3 block on read locks in their own threads.
+  BlockedTxn w2 = {&lm, t2, SHARED, false};
+  BlockedTxn w3 = {&lm, t3, SHARED, false};
+  pthread_t thread2, thread3;
+  pthread_create(&thread2, NULL, LockAndReport, &w2);
+  pthread_create(&thread3, NULL, LockAndReport, &w3);
+  usleep(10000);
+  EXPECT_FALSE(w2.granted);
+  EXPECT_FALSE(w3.granted);
+  EXPECT_EQ(EXCLUSIVE, lm.Status(101, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t1, owners[0]);
+
+  // Txn 1 releases lock. Txns 2 and 3 are both granted read locks.
+  lm.Release(t1, 101);
+  pthread_join(thread2, NULL);
+  pthread_join(thread3, NULL);
+  EXPECT_TRUE(w2.granted);
+  EXPECT_TRUE(w3.granted);
+  EXPECT_EQ(SHARED, lm.Status(101, &owners));
+  EXPECT_EQ(2, owners.size());
+
+  END;
+}
+
+TEST(ConcurrentLockManager_WaitersParkAndWakeInOrder) {
+  ConcurrentLockManager lm;
+  vector<Txn*> owners;
+
+  Txn* t1 = reinterpret_cast<Txn*>(1);
+  Txn* t2 = reinterpret_cast<Txn*>(2);
+  Txn* t3 = reinterpret_cast<Txn*>(3);
+
+  // Txn 1 holds a read lock; Txn 2 queues for a write lock, then Txn 3 for a
+  // read lock behind it.
+  lm.ReadLock(t1, 101);
+  BlockedTxn w2 = {&lm, t2, EXCLUSIVE, false};
+  BlockedTxn w3 = {&lm, t3, SHARED, false};
+  pthread_t thread2, thread3;
+  pthread_create(&thread2, NULL, LockAndReport, &w2);
+  usleep(10000);
+  pthread_create(&thread3, NULL, LockAndReport, &w3);
+  usleep(10000);
+
+  // Both are parked rather than spinning.
+  double start = CpuTime();
+  usleep(200000);
+  EXPECT_TRUE(CpuTime() - start < 0.05);
+  EXPECT_FALSE(w2.granted);
+  EXPECT_FALSE(w3.granted);
+
+  // Only the writer is woken when Txn 1 releases its lock...
+  lm.Release(t1, 101);
+  pthread_join(thread2, NULL);
+  EXPECT_TRUE(w2.granted);
+  usleep(10000);
+  EXPECT_FALSE(w3.granted);
+  EXPECT_EQ(EXCLUSIVE, lm.Status(101, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t2, owners[0]);
+
+  // ...and the reader once the writer releases it.
+  lm.Release(t2, 101);
+  pthread_join(thread3, NULL);
+  EXPECT_TRUE(w3.granted);
+  EXPECT_EQ(SHARED, lm.Status(101, &owners));
+  EXPECT_EQ(1, owners.size());
+  EXPECT_EQ(t3, owners[0]);
+
+  // Releasing the last lock empties the key's queue.
+  lm.Release(t3, 101);
+  EXPECT_EQ(UNLOCKED, lm.Status(101, &owners));
+  EXPECT_EQ(0, owners.size());
+  EXPECT_TRUE(lm.TryWriteLock(t1, 101));
+
+  END;
+}
+
+struct LockStress {
+  ConcurrentLockManager* lm;
+  int* counters;
+  int rounds;
+};
+
+// Repeatedly write-locks three random keys in increasing order, and bumps a
+// (non-atomic) counter per key while holding the locks.
+void* IncrementUnderLocks(void* arg) {
+  LockStress* s = reinterpret_cast<LockStress*>(arg);
+  Txn* txn = reinterpret_cast<Txn*>(pthread_self());
+  unsigned int seed = static_cast<unsigned int>(pthread_self());
+  for (int i = 0; i < s->rounds; i++) {
+    set<Key> keys;
+    while (keys.size() < 3)
+      keys.insert(rand_r(&seed) % 16);
+    for (set<Key>::iterator it = keys.begin(); it != keys.end(); ++it)
+      s->lm->WriteLock(txn, *it);
+    for (set<Key>::iterator it = keys.begin(); it != keys.end(); ++it)
+      s->counters[*it]++;
+    for (set<Key>::iterator it = keys.begin(); it != keys.end(); ++it)
+      s->lm->Release(txn, *it);
+  }
+  return NULL;
+}
+
+TEST(ConcurrentLockManager_ParallelWorkers) {
+  ConcurrentLockManager lm;
+  int counters[16] = {0};
+  LockStress s = {&lm, counters, 5000};
+
+  pthread_t threads[8];
+  for (int i = 0; i < 8; i++)
+    pthread_create(&threads[i], NULL, IncrementUnderLocks, &s);
+  for (int i = 0; i < 8; i++)
+    pthread_join(threads[i], NULL);
+
+  int total = 0;
+  for (int i = 0; i < 16; i++)
+    total += counters[i];
+  EXPECT_EQ(8 * 5000 * 3, total);
+
+  END;
+}
+
+TEST(TxnProcessor_LocksKeysReadAndWritten) {
+  // Each txn reads and writes key 2, which must only be write locked: a read
+  // lock queued behind the txn's own write lock would never be granted.
+  set<Key> readset, writeset;
+  readset.insert(1);
+  readset.insert(2);
+  writeset.insert(2);
+  writeset.insert(3);
+
+  TxnProcessor p(P_LOCKING);
+  for (int i = 0; i < 10; i++)
+    p.NewTxnRequest(new RMW(readset, writeset));
+  int committed = 0;
+  for (int i = 0; i < 10; i++) {
+    Txn* txn = p.GetTxnResult();
+    if (txn->Status() == COMMITTED)
+      committed++;
+    delete txn;
+  }
+  EXPECT_EQ(10, committed);
+
+  END;
+}
+
+// Submits more than twice TXN_QUEUE_CAPACITY contended txns before reading a
+// single result, so the request ring fills up while restarted txns and
+// results keep coming.
+int SubmitAllThenCollect(CCMode mode) {
+  int count = 2 * TXN_QUEUE_CAPACITY + 1000;
+  TxnProcessor p(mode);
+  for (int i = 0; i < count; i++) {
+    set<Key> keys;
+    keys.insert(i % 100);
+    keys.insert((i + 1) % 100);
+    p.NewTxnRequest(new RMW(set<Key>(), keys));
+  }
+  int committed = 0;
+  for (int i = 0; i < count; i++) {
+    Txn* txn = p.GetTxnResult(60);
+    if (txn == NULL)
+      break;
+    if (txn->Status() == COMMITTED)
+      committed++;
+    delete txn;
+  }
+  return count - committed;
+}
+
+TEST(TxnProcessor_SubmitAllThenCollect) {
+  // LOCKING and OCC restart txns on the scheduler thread.
+  EXPECT_EQ(0, SubmitAllThenCollect(LOCKING));
+  EXPECT_EQ(0, SubmitAllThenCollect(OCC));
+
+  END;
+}
+
+TEST(TxnProcessor_DestroyWithTxnsInFlight) {
+  // Deleting a processor stops its scheduler and background threads before
+  // its thread pool, so none of them hands a stopped pool new work.
+  CCMode modes[] = {LOCKING, OCC, P_OCC, MVCC, SSI, STRIFE_PIPELINED, SILO};
+  for (int m = 0; m < 7; m++) {
+    TxnProcessor* p = new TxnProcessor(modes[m]);
+    for (int i = 0; i < 10000; i++) {
+      set<Key> keys;
+      keys.insert(i % 100);
+      p->NewTxnRequest(new RMW(set<Key>(), keys));
+    }
+    delete p;
+  }
+
+  END;
+}
+
 int main(int argc, char** argv) {
   LockManagerA_SimpleLocking();
   LockManagerA_LocksReleasedOutOfOrder();
   LockManagerB_SimpleLocking();
   LockManagerB_LocksReleasedOutOfOrder();
+  ConcurrentLockManager_SimpleLocking();
+  ConcurrentLockManager_BlockingHandoff();
+  ConcurrentLockManager_WaitersParkAndWakeInOrder();
+  ConcurrentLockManager_ParallelWorkers();
+  TxnProcessor_LocksKeysReadAndWritten();
+  TxnProcessor_SubmitAllThenCollect();
+  TxnProcessor_DestroyWithTxnsInFlight();
 }
 
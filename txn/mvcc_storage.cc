@@ -1,115 +1,413 @@
 
-
 #include "txn/mvcc_storage.h"
 
+#include <sched.h>
+#include <string.h>
+
+// Source of VersionArena ids.
+static std::atomic<uint64> next_arena_id(1);
+
+VersionArena::VersionArena()
+    : id_(next_arena_id.fetch_add(1)), batch_count_(0) {}
+
+VersionArena::~VersionArena() {
+  for (uint32 i = 0; i < slabs_.size(); i++)
+    delete[] slabs_[i];
+}
+
+VersionArena::LocalCache& VersionArena::Local() {
+  static __thread LocalCache cache = {0, NULL, 0, NULL, NULL};
+  if (cache.arena_id_ != id_) {
+    // Whatever is left in the old arena is freed along with its slabs.
+    cache.arena_id_ = id_;
+    cache.free_ = NULL;
+    cache.free_count_ = 0;
+    cache.next_ = NULL;
+    cache.end_ = NULL;
+  }
+  return cache;
+}
+
+Version* VersionArena::Allocate() {
+  LocalCache& cache = Local();
+  if (cache.free_ == NULL && batch_count_.load(std::memory_order_relaxed) > 0) {
+    mutex_.Lock();
+    if (!batches_.empty()) {
+      cache.free_ = batches_.back();
+      cache.free_count_ = VERSION_BATCH_SIZE;
+      batches_.pop_back();
+      batch_count_.fetch_sub(1);
+    }
+    mutex_.Unlock();
+  }
+
+  if (cache.free_ != NULL) {
+    Version* version = cache.free_;
+    cache.free_ = version->next_.load(std::memory_order_relaxed);
+    cache.free_count_--;
+    return version;
+  }
+
+  if (cache.next_ == cache.end_) {
+    Version* slab = new Version[VERSION_SLAB_SIZE];
+    mutex_.Lock();
+    slabs_.push_back(slab);
+    mutex_.Unlock();
+    cache.next_ = slab;
+    cache.end_ = slab + VERSION_SLAB_SIZE;
+  }
+  return cache.next_++;
+}
+
+void VersionArena::Free(Version* version) {
+  LocalCache& cache = Local();
+  version->next_.store(cache.free_, std::memory_order_relaxed);
+  cache.free_ = version;
+  if (++cache.free_count_ < 2 * VERSION_BATCH_SIZE)
+    return;
+
+  // Keep one batch and hand the other to the shared pool.
+  Version* batch = cache.free_;
+  Version* last = batch;
+  for (int i = 1; i < VERSION_BATCH_SIZE; i++)
+    last = last->next_.load(std::memory_order_relaxed);
+  cache.free_ = last->next_.load(std::memory_order_relaxed);
+  cache.free_count_ -= VERSION_BATCH_SIZE;
+  last->next_.store(NULL, std::memory_order_relaxed);
+
+  mutex_.Lock();
+  batches_.push_back(batch);
+  batch_count_.fetch_add(1);
+  mutex_.Unlock();
+}
+
+MVCCStorage::MVCCStorage()
+    : gc_candidates_(MVCC_KEY_RANGE), reclaimed_versions_(0),
+      keys_collected_(0), chain_length_total_(0), max_chain_length_(0),
+      records_(NULL) {}
+
 // Init the storage
 void MVCCStorage::InitStorage() {
-  for (int i = 0; i < 1000011;i++) {
+  void* mem;
+  if (posix_memalign(&mem, CACHE_LINE_SIZE,
+                     sizeof(MVCCRecord) * MVCC_KEY_RANGE) != 0)
+    DIE("Could not allocate MVCC record array.");
+  memset(mem, 0, sizeof(MVCCRecord) * MVCC_KEY_RANGE);
+  records_ = reinterpret_cast<MVCCRecord*>(mem);
+  for (int i = 0; i < MVCC_KEY_RANGE;i++) {
     Write(i, 0, 0);
-    Mutex* key_mutex = new Mutex();
-    mutexs_[i] = key_mutex;
   }
 }
 
-// Free memory.
+// Free memory. Versions that are not inline go with the arena.
 MVCCStorage::~MVCCStorage() {
-  for (unordered_map<Key, deque<Version*>*>::iterator it = mvcc_data_.begin();
-       it != mvcc_data_.end(); ++it) {
-    delete it->second;          
-  }
-  
-  mvcc_data_.clear();
-  
-  for (unordered_map<Key, Mutex*>::iterator it = mutexs_.begin();
-       it != mutexs_.end(); ++it) {
-    delete it->second;          
-  }
-  
-  mutexs_.clear();
+  free(records_);
+}
+
+MVCCRecord* MVCCStorage::LookupRecord(Key key) {
+  if (key >= MVCC_KEY_RANGE)
+    DIE("MVCC key out of range: " << key);
+  return &records_[key];
 }
 
-// Lock the key to protect its version_list. Remember to lock the key when you read/update the version_list 
+// Latch the key against other writers. Readers never wait for it.
 void MVCCStorage::Lock(Key key) {
-  mutexs_[key]->Lock();
+  MVCCRecord* record = LookupRecord(key);
+  while (record->latch_.exchange(true, std::memory_order_acquire))
+    sched_yield();
 }
 
-// Unlock the key.
+// Unlatch the key.
 void MVCCStorage::Unlock(Key key) {
-  mutexs_[key]->Unlock();
+  LookupRecord(key)->latch_.store(false, std::memory_order_release);
+}
+
+Version* MVCCStorage::Visible(MVCCRecord* record, uint64 txn_unique_id) {
+  // versions are sorted in decreasing order, so first version that is less
+  // than or equal is most recent
+  Version* version = &record->newest_;
+  while (version != NULL &&
+         (version->version_id_ > txn_unique_id ||
+          version->state_.load() == VERSION_DEAD))
+    version = version->next_.load();
+  return version;
+}
+
+Version* MVCCStorage::Find(MVCCRecord* record, uint64 txn_unique_id) {
+  Version* version = &record->newest_;
+  while (version->version_id_ != txn_unique_id)
+    version = version->next_.load();
+  return version;
 }
 
 // MVCC Read
-bool MVCCStorage::Read(Key key, Value* result, int txn_unique_id) {
-  //
-  // Implement this method!
-  
-  // Hint: Iterate the version_lists and return the verion whose write timestamp
-  // (version_id) is the largest write timestamp less than or equal to txn_unique_id.
-  
-  deque<Version*>* key_vals = mvcc_data_[key];
-  if (!key_vals) // key doesn't exist: no possible values
+bool MVCCStorage::Read(Key key, Value* result, uint64 txn_unique_id) {
+  if (key >= MVCC_KEY_RANGE) // key doesn't exist: no possible values
     return false;
-  for (deque<Version*>::iterator it = key_vals->begin();
-    it != key_vals->end(); ++it) {
-      // versions are sorted in decreasing order, so first version that is less than or equal is most recent
-      if ((*it)->version_id_ <= txn_unique_id) {
-        *result = (*it)->value_;
-        if ((*it)->max_read_id_ < txn_unique_id)
-          (*it)->max_read_id_ = txn_unique_id;
-        return true;
-      }
+  MVCCRecord* record = &records_[key];
+
+  while (true) {
+    uint32 seq = record->seq_.load();
+    if (seq & 1) {
+      // A writer is replacing the inline version; let it finish.
+      sched_yield();
+      continue;
+    }
+    Version* version = Visible(record, txn_unique_id);
+    if (version == NULL) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (record->seq_.load() == seq)
+        return false;
+      continue;
+    }
+    uint64 version_id = version->version_id_;
+    Value value = version->value_;
+    if (version->state_.load() == VERSION_PENDING) {
+      // Its writer is deciding whether to commit; the outcome decides what
+      // this txn reads.
+      sched_yield();
+      continue;
+    }
+
+    // Record the read. A writer links its pending version before checking
+    // max_read_id_, so either it sees this read and aborts, or the version
+    // it linked is visible to the second lookup below. A writer that moves
+    // the inline version out makes 'seq_' odd before copying max_read_id_, so
+    // if 'seq_' is unchanged below, the copy includes this read. Otherwise
+    // the read is retried; a timestamp recorded in the wrong version only
+    // makes writers more cautious.
+    uint64 max_read = version->max_read_id_.load();
+    while (max_read < txn_unique_id &&
+           !version->max_read_id_.compare_exchange_weak(max_read,
+                                                        txn_unique_id)) {}
+    Version* again = Visible(record, txn_unique_id);
+    bool same = again == version && again->version_id_ == version_id;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (same && record->seq_.load() == seq) {
+      *result = value;
+      return true;
+    }
   }
-  return false;
 }
 
+bool MVCCStorage::ReadSnapshot(Key key, Value* result, uint64 snapshot) {
+  if (key >= MVCC_KEY_RANGE)
+    return false;
+  MVCCRecord* record = &records_[key];
+
+  // No writer at or below the snapshot is left, so no version seen here is
+  // pending; only the inline version can change under the read.
+  while (true) {
+    uint32 seq = record->seq_.load(std::memory_order_acquire);
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+    Version* version = Visible(record, snapshot);
+    Value value = version == NULL ? 0 : version->value_;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record->seq_.load(std::memory_order_relaxed) != seq)
+      continue;
+    if (version == NULL)
+      return false;
+    *result = value;
+    return true;
+  }
+}
 
 // Check whether apply or abort the write
-bool MVCCStorage::CheckWrite(Key key, int txn_unique_id) {
-  //
-  // Implement this method!
-  
-  // Hint: Before all writes are applied, we need to make sure that each write
-  // can be safely applied based on MVCC timestamp ordering protocol. This method
-  // only checks one key, so you should call this method for each key in the
-  // write_set. Return true if this key passes the check, return false if not. 
-  // Note that you don't have to call Lock(key) in this method, just
-  // call Lock(key) before you call this method and call Unlock(key) afterward.
-  
-  deque<Version*> *key_vals = mvcc_data_[key];
-  for (deque<Version*>::iterator it = key_vals->begin();
-    it != key_vals->end(); ++it) {
-      if ((*it)->version_id_ <= txn_unique_id) {
-	
-        if ((*it)->max_read_id_ > txn_unique_id)
-          return false;
-        else
-          return true;
-		  }
+bool MVCCStorage::CheckWrite(Key key, uint64 txn_unique_id) {
+  // The superseded version is the newest one visible just below the txn's
+  // own timestamp, which skips the txn's own pending version. Other writers
+  // hold no pending versions here, since the caller holds the latch.
+  Version* version = Visible(LookupRecord(key), txn_unique_id - 1);
+  return version == NULL || version->max_read_id_.load() <= txn_unique_id;
+}
+
+void MVCCStorage::Link(Key key, MVCCRecord* record, Value value,
+                       uint64 txn_unique_id, int state) {
+  Version* newest = &record->newest_;
+  Version* version;
+  uint32 length = record->length_;
+
+  if (length == 0 || txn_unique_id > newest->version_id_) {
+    // The new version goes inline. The one it replaces moves to an arena
+    // node, unless it is dead and may simply be dropped.
+    Version* older = newest->next_.load();
+    bool move = length > 0 && newest->state_.load() != VERSION_DEAD;
+    Version* moved = move ? arena_.Allocate() : NULL;
+    record->seq_.fetch_add(1);
+    if (move) {
+      moved->value_ = newest->value_;
+      moved->version_id_ = newest->version_id_;
+      moved->max_read_id_.store(newest->max_read_id_.load());
+      moved->state_.store(newest->state_.load());
+      moved->readers_.store(newest->readers_.load());
+      moved->out_conflict_.store(newest->out_conflict_.load());
+      moved->next_.store(older);
+      older = moved;
+      record->length_++;
+    } else if (length == 0) {
+      record->length_++;
+    }
+    version = newest;
+    version->next_.store(older);
+  } else {
+    // An older version (e.g. from a txn with an earlier timestamp that
+    // commits late) goes into the list below the inline one.
+    version = arena_.Allocate();
+    record->length_++;
+  }
+
+  version->value_ = value;
+  version->version_id_ = txn_unique_id;
+  version->max_read_id_.store(txn_unique_id);
+  version->state_.store(state);
+  version->readers_.store(0);
+  version->out_conflict_.store(false);
+
+  if (version == newest) {
+    record->seq_.fetch_add(1, std::memory_order_release);
+  } else {
+    Version* prev = newest;
+    Version* next = prev->next_.load();
+    while (next != NULL && next->version_id_ > txn_unique_id) {
+      prev = next;
+      next = next->next_.load();
+    }
+    version->next_.store(next);
+    prev->next_.store(version);
+  }
+
+  if (record->length_ == 2 && length == 1)
+    gc_candidates_.Push(key);
+}
+
+void MVCCStorage::WritePending(Key key, Value value, uint64 txn_unique_id) {
+  Link(key, LookupRecord(key), value, txn_unique_id, VERSION_PENDING);
+}
+
+void MVCCStorage::FinishWrite(Key key, uint64 txn_unique_id, bool commit,
+                              bool out_conflict) {
+  Version* version = Find(LookupRecord(key), txn_unique_id);
+  version->out_conflict_.store(out_conflict);
+  version->state_.store(commit ? VERSION_COMMITTED : VERSION_DEAD);
+}
+
+bool MVCCStorage::ReadRegistered(Key key, Value* result, uint64 snapshot,
+                                 uint64* version_id) {
+  if (key >= MVCC_KEY_RANGE)
+    return false;
+  // Under the latch, a writer certifying key either counts this reader or
+  // has installed its version already; then this read still sees the older
+  // one, and the reader's NewerWrites finds the writer's.
+  Lock(key);
+  Version* version = Visible(&records_[key], snapshot);
+  if (version != NULL) {
+    version->readers_.fetch_add(1);
+    *result = version->value_;
+    *version_id = version->version_id_;
   }
-  return true;
+  Unlock(key);
+  return version != NULL;
+}
+
+void MVCCStorage::FinishRead(Key key, uint64 version_id, uint64 commit_ts) {
+  Version* version = Find(LookupRecord(key), version_id);
+  if (commit_ts != 0) {
+    uint64 max_read = version->max_read_id_.load();
+    while (max_read < commit_ts &&
+           !version->max_read_id_.compare_exchange_weak(max_read, commit_ts)) {}
+  }
+  version->readers_.fetch_sub(1);
+}
+
+int MVCCStorage::NewerWrites(Key key, uint64 snapshot) {
+  // The caller holds the latch, so no version here is pending.
+  int result = SSI_NO_NEWER;
+  Version* version = &LookupRecord(key)->newest_;
+  while (version != NULL && version->version_id_ > snapshot) {
+    if (version->state_.load() == VERSION_COMMITTED) {
+      if (version->out_conflict_.load())
+        return SSI_NEWER_OUT_CONFLICT;
+      result = SSI_NEWER;
+    }
+    version = version->next_.load();
+  }
+  return result;
+}
+
+bool MVCCStorage::HasConcurrentReaders(Key key, uint64 snapshot,
+                                       uint64 txn_unique_id, bool own_read) {
+  Version* version = Visible(LookupRecord(key), txn_unique_id - 1);
+  if (version == NULL)
+    return false;
+  uint32 others = version->readers_.load() - (own_read ? 1 : 0);
+  return others > 0 || version->max_read_id_.load() > snapshot;
 }
 
 // MVCC Write, call this method only if CheckWrite return true.
-void MVCCStorage::Write(Key key, Value value, int txn_unique_id) {
-  //
-  // Implement this method!
-  
-  // Hint: Insert a new version (malloc a Version and specify its value/version_id/max_read_id)
-  // into the version_lists. Note that InitStorage() also calls this method to init storage. 
-  // Note that you don't have to call Lock(key) in this method, just
-  // call Lock(key) before you call this method and call Unlock(key) afterward.
-  // Note that the performance would be much better if you organize the versions in decreasing order.
-  
-  if (!mvcc_data_[key]) { // key doesn't exist
-    mvcc_data_[key] = new std::deque<Version*>;
+void MVCCStorage::Write(Key key, Value value, uint64 txn_unique_id) {
+  Link(key, LookupRecord(key), value, txn_unique_id, VERSION_COMMITTED);
+}
+
+int MVCCStorage::CollectGarbage(uint64 watermark, int max_keys) {
+  vector<Key> requeue;
+  Key key;
+  int visited = 0;
+  while (visited < max_keys && gc_candidates_.Pop(&key)) {
+    visited++;
+    Lock(key);
+    MVCCRecord* record = &records_[key];
+    uint64 length = record->length_;
+
+    // Keep every version newer than the watermark plus the newest committed
+    // one at or below it. Readers all have timestamps at or above the
+    // watermark, so none of them ever walks past that version.
+    Version* keep = &record->newest_;
+    while (keep != NULL &&
+           (keep->version_id_ > watermark ||
+            keep->state_.load() != VERSION_COMMITTED))
+      keep = keep->next_.load();
+    uint64 freed = 0;
+    if (keep != NULL) {
+      Version* version = keep->next_.load();
+      keep->next_.store(NULL);
+      while (version != NULL) {
+        Version* next = version->next_.load();
+        arena_.Free(version);
+        version = next;
+        freed++;
+      }
+    }
+    record->length_ -= freed;
+    if (record->length_ > 1)
+      requeue.push_back(key);
+    Unlock(key);
+
+    reclaimed_versions_.fetch_add(freed, std::memory_order_relaxed);
+    keys_collected_.fetch_add(1, std::memory_order_relaxed);
+    chain_length_total_.fetch_add(length, std::memory_order_relaxed);
+    if (length > max_chain_length_.load(std::memory_order_relaxed))
+      max_chain_length_.store(length, std::memory_order_relaxed);
   }
-  deque<Version*> *key_vals = mvcc_data_[key];
-  Version *new_version = (Version*)malloc(sizeof(Version));
-  new_version->value_ = value;
-  new_version->version_id_ = txn_unique_id;
-  new_version->max_read_id_ = txn_unique_id;
-  
-  key_vals->push_front(new_version);
+
+  // Chains still waiting for the watermark to advance are retried in a later
+  // round.
+  if (!requeue.empty())
+    gc_candidates_.PushMany(requeue.data(), requeue.size());
+  return visited;
 }
 
+MVCCGCStats MVCCStorage::GCStats() {
+  MVCCGCStats stats;
+  stats.reclaimed_versions_ = reclaimed_versions_.load();
+  stats.reclaimed_bytes_ = stats.reclaimed_versions_ * sizeof(Version);
+  stats.keys_collected_ = keys_collected_.load();
+  stats.mean_chain_length_ =
+      stats.keys_collected_ == 0 ? 0 :
+      static_cast<double>(chain_length_total_.load()) / stats.keys_collected_;
+  stats.max_chain_length_ = max_chain_length_.load();
+  return stats;
+}
 
@@ -2,58 +2,241 @@
 #ifndef _MVCC_STORAGE_H_
 #define _MVCC_STORAGE_H_
 
+#include <atomic>
+
 #include "txn/storage.h"
+#include "txn/dense_storage.h"
+#include "utils/lock_free_queue.h"
+#include "utils/mutex.h"
+
+// Number of keys that InitStorage() creates, i.e. keys [0, MVCC_KEY_RANGE).
+#define MVCC_KEY_RANGE 1000011
+
+// States of an MVCC version.
+#define VERSION_PENDING 0    // Installed by a txn that has not committed yet
+#define VERSION_COMMITTED 1  // Written by a committed txn
+#define VERSION_DEAD 2       // Written by a txn that aborted; readers skip it
+
+// Number of Version nodes a thread carves out of a VersionArena slab at once,
+// and number of freed nodes it hands back to the arena's shared pool at once.
+#define VERSION_SLAB_SIZE 1024
+#define VERSION_BATCH_SIZE 256
+
+// Results of MVCCStorage::NewerWrites.
+#define SSI_NO_NEWER 0            // No other txn wrote the key after the snapshot
+#define SSI_NEWER 1               // Some txn did
+#define SSI_NEWER_OUT_CONFLICT 2  // Some txn did and committed with an out-conflict
 
-// MVCC 'version' structure
+// MVCC 'version' structure. Versions of a key form a singly linked list from
+// newest to oldest write timestamp. In SSI mode 'max_read_id_' holds the
+// largest commit timestamp of a committed txn that read the version instead.
 struct Version {
   Value value_;      // The value of this version
-  int max_read_id_;  // Largest timestamp of a transaction that read the version
-  int version_id_;   // Timestamp of the transaction that created(wrote) the version
+  std::atomic<uint64> max_read_id_;  // Largest timestamp of a transaction that read the version
+  uint64 version_id_;   // Timestamp of the transaction that created(wrote) the version
+  std::atomic<int> state_;           // VERSION_PENDING, _COMMITTED or _DEAD
+  std::atomic<uint32> readers_;      // SSI: running txns that read the version
+  std::atomic<bool> out_conflict_;   // SSI: writer committed with an out-conflict
+  std::atomic<Version*> next_;       // Next older version
+};
+
+// Per-key record, exactly one cache line. The newest version of the key lives
+// inline in 'newest_', so reading the latest value touches no other line;
+// older versions hang off newest_.next_ in VersionArena nodes. 'latch_'
+// serializes writers (and the garbage collector) on the key; readers never
+// take it, and instead retry if 'seq_' shows that a writer replaced 'newest_'
+// under them (it is odd while a writer does).
+struct MVCCRecord {
+  std::atomic<uint32> seq_;
+  uint32 length_;    // Number of versions in the list, guarded by 'latch_'
+  std::atomic<bool> latch_;
+  Version newest_;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// Allocator for the Version nodes holding all but the newest version of each
+// key. Each thread appends nodes to its own slab and reuses the nodes it
+// frees, so writers never contend on a shared heap. A thread that has freed
+// more than it needs (in practice the garbage collector) hands whole batches
+// to a shared pool that the other threads refill from.
+class VersionArena {
+ public:
+  VersionArena();
+
+  // Frees every slab, and with them every node.
+  ~VersionArena();
+
+  // Returns an uninitialized node.
+  Version* Allocate();
+
+  // Recycles 'version', which no thread may still reach.
+  void Free(Version* version);
+
+ private:
+  // A thread's free nodes, linked through next_, and the unused rest of its
+  // current slab.
+  struct LocalCache {
+    uint64 arena_id_;
+    Version* free_;
+    int free_count_;
+    Version* next_;
+    Version* end_;
+  };
+
+  // Returns the calling thread's cache, emptied first if it belonged to
+  // another arena.
+  LocalCache& Local();
+
+  // Unique id, so that a thread never mistakes a new arena at the address of
+  // a deleted one for the one its cache belongs to.
+  uint64 id_;
+
+  // Shared pool of free node batches of VERSION_BATCH_SIZE each, and every
+  // slab allocated so far. 'batch_count_' lets threads skip the mutex when
+  // the pool is empty.
+  Mutex mutex_;
+  vector<Version*> batches_;
+  std::atomic<int> batch_count_;
+  vector<Version*> slabs_;
+};
+
+// Garbage collection counters, as reported by MVCCStorage::GCStats().
+struct MVCCGCStats {
+  uint64 reclaimed_versions_;  // Versions freed so far
+  uint64 reclaimed_bytes_;     // Bytes freed so far
+  uint64 keys_collected_;      // Version chains visited so far
+  double mean_chain_length_;   // Mean chain length seen before trimming
+  uint64 max_chain_length_;    // Longest chain seen before trimming
 };
 
-// MVCC storage
+// MVCC storage. Readers walk the version lists without taking any latch and
+// record their timestamp in the version they read with an atomic max. A writer
+// latches the keys it writes, links a pending version into each list, checks
+// that no newer txn has read the version it supersedes, and then marks its
+// versions committed or dead. Linking a version newer than the inline one
+// first copies the inline one out to an arena node.
 class MVCCStorage : public Storage {
  public:
+  MVCCStorage();
+
   // If there exists a record for the specified key, sets '*result' equal to
   // the value associated with the key and returns true, else returns false;
   // The third parameter is the txn_unique_id(txn timestamp), which is used for MVCC.
-  virtual bool Read(Key key, Value* result, int txn_unique_id = 0);
+  // Waits for the writer of a pending version the txn would read to finish.
+  virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
+
+  // Sets '*result' to the value of the newest version of key at or below
+  // 'snapshot' and returns true, or returns false if there is none. Leaves
+  // max_read_id_ untouched. Requires that every txn with a timestamp at or
+  // below 'snapshot' has finished, so the versions it sees never change.
+  bool ReadSnapshot(Key key, Value* result, uint64 snapshot);
 
-  // Inserts a new version with key and value
+  // Inserts a new committed version with key and value. Requires Lock(key)
+  // while other threads use the storage.
   // The third parameter is the txn_unique_id(txn timestamp), which is used for MVCC.
-  virtual void Write(Key key, Value value, int txn_unique_id = 0);
+  virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
 
-  // Returns the timestamp at which the record with the specified key was last
-  // updated (returns 0 if the record has never been updated). This is used for OCC.
-  virtual double Timestamp(Key key) {return 0;}
+  // Record versions are only used for OCC.
+  virtual uint64 RecordVersion(Key key) {return 0;}
   
   // Init storage
   virtual void InitStorage();
   
-  // Lock the version_list of key
+  // Latch the version list of key against other writers
   virtual void Lock(Key key);
   
-  // Unlock the version_list of key
+  // Unlatch the version list of key
   virtual void Unlock(Key key);
   
-  // Check whether apply or abort the write
-  virtual bool CheckWrite (Key key, int txn_unique_id);
+  // Returns true iff no txn newer than 'txn_unique_id' has read the version
+  // that a write by 'txn_unique_id' supersedes, ignoring the txn's own
+  // pending version. Requires Lock(key).
+  virtual bool CheckWrite (Key key, uint64 txn_unique_id);
+
+  // Links a pending version of key written by 'txn_unique_id' into the list.
+  // Readers that would read it wait until FinishWrite. Requires Lock(key).
+  void WritePending(Key key, Value value, uint64 txn_unique_id);
+
+  // Marks the pending version written by 'txn_unique_id' committed (or dead if
+  // 'commit' is false), recording whether its writer committed with an SSI
+  // out-conflict. Requires Lock(key).
+  void FinishWrite(Key key, uint64 txn_unique_id, bool commit,
+                   bool out_conflict = false);
+
+  // The following methods are for SSI mode, in which txns read a snapshot and
+  // track rw-antidependencies through the versions they read and write.
+
+  // Same as ReadSnapshot, but also registers the caller as a running reader of
+  // the version read and sets '*version_id' to its id. Latches key briefly, so
+  // the caller must not hold Lock(key).
+  bool ReadRegistered(Key key, Value* result, uint64 snapshot,
+                      uint64* version_id);
+
+  // Unregisters a running reader of version 'version_id' of key. A nonzero
+  // 'commit_ts' means the reader committed at 'commit_ts', which is recorded
+  // first. Requires Lock(key).
+  void FinishRead(Key key, uint64 version_id, uint64 commit_ts);
+
+  // Classifies the versions of key newer than 'snapshot' (see SSI_NO_NEWER
+  // and friends). Requires Lock(key).
+  int NewerWrites(Key key, uint64 snapshot);
+
+  // Returns true iff the version that a write by 'txn_unique_id' supersedes
+  // was read by a txn other than the caller that is still running or that
+  // committed after 'snapshot'. 'own_read' tells whether the caller read key
+  // (and hence that version) itself. Requires Lock(key).
+  bool HasConcurrentReaders(Key key, uint64 snapshot, uint64 txn_unique_id,
+                            bool own_read);
   
   virtual ~MVCCStorage();
 
-  virtual Cluster* getCluster(Key key) {return NULL;}
+  // Trims the version chains of up to 'max_keys' keys that have more than one
+  // version, freeing every version older than the newest one visible at
+  // 'watermark'. Requires that no txn with a timestamp below 'watermark' reads
+  // the storage any more. Each chain is trimmed under its own key lock, so
+  // writers to other keys never wait. Returns the number of keys visited.
+  int CollectGarbage(uint64 watermark, int max_keys);
 
-  virtual uintptr_t getM() {return 0;}
+  // Returns the garbage collection counters accumulated so far.
+  MVCCGCStats GCStats();
 
  private:
  
   friend class TxnProcessor;
+
+  // Keys whose chains hold more than one version. A key is pushed when its
+  // chain grows from one version to two, or re-pushed by CollectGarbage if it
+  // could not be trimmed to one, so it is never queued twice.
+  LockFreeQueue<Key> gc_candidates_;
+
+  // Garbage collection counters.
+  std::atomic<uint64> reclaimed_versions_;
+  std::atomic<uint64> keys_collected_;
+  std::atomic<uint64> chain_length_total_;
+  std::atomic<uint64> max_chain_length_;
   
-  // Storage for MVCC, each key has a linklist of versions
-  unordered_map<Key, deque<Version*>*> mvcc_data_;
-  
-  // Mutexs for each key
-  unordered_map<Key, Mutex*> mutexs_;
+  // Returns the record of 'key'. Dies if 'key' is out of range.
+  MVCCRecord* LookupRecord(Key key);
+
+  // Returns the newest version of '*record' visible at 'txn_unique_id', i.e.
+  // with the largest version id at or below it, skipping dead versions.
+  // Returns NULL if there is none. Without the record's latch, the result is
+  // only valid if 'seq_' did not change meanwhile.
+  Version* Visible(MVCCRecord* record, uint64 txn_unique_id);
+
+  // Returns the version of '*record' written by 'txn_unique_id'. Requires the
+  // record's latch.
+  Version* Find(MVCCRecord* record, uint64 txn_unique_id);
+
+  // Links a new version of key written by 'txn_unique_id' into '*record''s
+  // list, keeping it sorted by version id. Requires the record's latch.
+  void Link(Key key, MVCCRecord* record, Value value, uint64 txn_unique_id,
+            int state);
+
+  // Storage for MVCC: a record for each key in [0, MVCC_KEY_RANGE)
+  MVCCRecord* records_;
+
+  // Nodes for the versions that are not inline.
+  VersionArena arena_;
 };
 
 #endif  // _MVCC_STORAGE_H_
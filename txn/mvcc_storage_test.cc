@@ -0,0 +1,273 @@
+#include "txn/mvcc_storage.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <map>
+#include <set>
+
+#include "txn/txn_processor.h"
+#include "txn/txn_types.h"
+#include "utils/testing.h"
+
+using std::map;
+using std::set;
+
+TEST(MVCCStorage_ReadSnapshotLeavesReadTimestamps) {
+  MVCCStorage storage;
+  storage.InitStorage();
+  Value v;
+
+  storage.Write(3, 30, 5);
+  EXPECT_TRUE(storage.ReadSnapshot(3, &v, 10));
+  EXPECT_EQ(30, v);
+  EXPECT_TRUE(storage.ReadSnapshot(3, &v, 4));
+  EXPECT_EQ(0, v);
+
+  // A snapshot read is not recorded, so a write at 6 may still supersede the
+  // version at 5...
+  storage.Lock(3);
+  EXPECT_TRUE(storage.CheckWrite(3, 6));
+  storage.Unlock(3);
+
+  // ...while a read at timestamp 10 rules that out.
+  EXPECT_TRUE(storage.Read(3, &v, 10));
+  EXPECT_EQ(30, v);
+  storage.Lock(3);
+  EXPECT_FALSE(storage.CheckWrite(3, 6));
+  storage.Unlock(3);
+
+  END;
+}
+
+TEST(MVCCStorage_NewerWrites) {
+  MVCCStorage storage;
+  storage.InitStorage();
+
+  // Only the initial version, at 0.
+  storage.Lock(1);
+  EXPECT_EQ(SSI_NO_NEWER, storage.NewerWrites(1, 0));
+
+  // A committed write at 5 is newer than snapshots below 5 only.
+  storage.WritePending(1, 10, 5);
+  storage.FinishWrite(1, 5, true);
+  EXPECT_EQ(SSI_NEWER, storage.NewerWrites(1, 4));
+  EXPECT_EQ(SSI_NO_NEWER, storage.NewerWrites(1, 5));
+
+  // Dead versions do not count.
+  storage.WritePending(1, 11, 7);
+  storage.FinishWrite(1, 7, false);
+  EXPECT_EQ(SSI_NO_NEWER, storage.NewerWrites(1, 5));
+  EXPECT_EQ(SSI_NEWER, storage.NewerWrites(1, 4));
+
+  // A newer write whose txn committed with an out-conflict wins over plain
+  // ones.
+  storage.WritePending(1, 12, 9);
+  storage.FinishWrite(1, 9, true, true);
+  EXPECT_EQ(SSI_NEWER_OUT_CONFLICT, storage.NewerWrites(1, 8));
+  EXPECT_EQ(SSI_NEWER_OUT_CONFLICT, storage.NewerWrites(1, 4));
+  EXPECT_EQ(SSI_NO_NEWER, storage.NewerWrites(1, 9));
+  storage.Unlock(1);
+
+  END;
+}
+
+TEST(MVCCStorage_HasConcurrentReaders) {
+  MVCCStorage storage;
+  storage.InitStorage();
+  Value v;
+  uint64 version_id;
+
+  // Nobody read the initial version of key 2.
+  storage.Lock(2);
+  EXPECT_FALSE(storage.HasConcurrentReaders(2, 10, 11, false));
+  storage.Unlock(2);
+
+  // A running reader counts, unless it is the writer itself.
+  EXPECT_TRUE(storage.ReadRegistered(2, &v, 10, &version_id));
+  EXPECT_EQ(0, version_id);
+  storage.Lock(2);
+  EXPECT_TRUE(storage.HasConcurrentReaders(2, 10, 11, false));
+  EXPECT_FALSE(storage.HasConcurrentReaders(2, 10, 11, true));
+
+  // Once it commits at 12, it counts for writers whose snapshot is older.
+  storage.FinishRead(2, version_id, 12);
+  EXPECT_TRUE(storage.HasConcurrentReaders(2, 10, 13, false));
+  EXPECT_FALSE(storage.HasConcurrentReaders(2, 12, 13, false));
+  storage.Unlock(2);
+
+  // A reader that aborts leaves nothing behind.
+  EXPECT_TRUE(storage.ReadRegistered(2, &v, 20, &version_id));
+  storage.Lock(2);
+  storage.FinishRead(2, version_id, 0);
+  EXPECT_FALSE(storage.HasConcurrentReaders(2, 12, 21, false));
+  storage.Unlock(2);
+
+  END;
+}
+
+// Read-only txn that reads a group of keys and commits iff they all hold the
+// same value, counting its runs in '*runs_'.
+class GroupCheck : public Txn {
+ public:
+  GroupCheck(const set<Key>& keys, std::atomic<int>* runs) : runs_(runs) {
+    readset_.insert(keys.begin(), keys.end());
+    read_only_ = true;
+  }
+
+  GroupCheck* clone() const {
+    GroupCheck* clone = new GroupCheck(set<Key>(), runs_);
+    this->CopyTxnInternals(clone);
+    return clone;
+  }
+
+  virtual void Run() {
+    (*runs_)++;
+    Value first = 0, result = 0;
+    for (KeySet::iterator it = readset_.begin(); it != readset_.end(); ++it) {
+      if (!Read(*it, &result))
+        ABORT;
+      if (it == readset_.begin())
+        first = result;
+      else if (result != first)
+        ABORT;
+    }
+    COMMIT;
+  }
+
+ private:
+  std::atomic<int>* runs_;
+};
+
+TEST(TxnProcessor_MVCCReadOnlySnapshots) {
+  // Writers bump keys 1 to 5 together, so any snapshot holds them all equal.
+  // Key 10 is never written.
+  set<Key> group;
+  for (Key k = 1; k <= 5; k++)
+    group.insert(k);
+  map<Key, Value> untouched;
+  untouched[10] = 0;
+
+  TxnProcessor p(MVCC);
+  std::atomic<int> runs(0);
+  for (int i = 0; i < 200; i++) {
+    p.NewTxnRequest(new RMW(group));
+    p.NewTxnRequest(new GroupCheck(group, &runs));
+    p.NewTxnRequest(new Expect(untouched));
+    p.NewTxnRequest(new RMW(group, set<Key>()));
+  }
+  int committed = 0;
+  for (int i = 0; i < 4 * 200; i++) {
+    Txn* txn = p.GetTxnResult();
+    if (txn->Status() == COMMITTED)
+      committed++;
+    delete txn;
+  }
+
+  // Every reader saw a consistent snapshot, and ran exactly once.
+  EXPECT_EQ(4 * 200, committed);
+  EXPECT_EQ(200, runs.load());
+
+  // Readers leave no read timestamps behind: a write older than all of them
+  // could still supersede the versions they read.
+  uint64 next = p.timestamps_.Peek();
+  for (int i = 0; i < 100; i++) {
+    p.NewTxnRequest(new GroupCheck(group, &runs));
+    delete p.GetTxnResult();
+  }
+  MVCCStorage* storage = static_cast<MVCCStorage*>(p.storage_);
+  bool writable = true;
+  for (Key k = 1; k <= 5; k++) {
+    storage->Lock(k);
+    writable = writable && storage->CheckWrite(k, next);
+    storage->Unlock(k);
+  }
+  EXPECT_TRUE(writable);
+
+  map<Key, Value> final_values;
+  for (Key k = 1; k <= 5; k++)
+    final_values[k] = 200;
+  p.NewTxnRequest(new Expect(final_values));
+  Txn* txn = p.GetTxnResult();
+  EXPECT_EQ(COMMITTED, txn->Status());
+  delete txn;
+
+  END;
+}
+
+// Write skew: a doctor goes off call if both doctors 'me_' and 'other_' are
+// on call (value 1). Under plain snapshot isolation, two such txns for the
+// same pair both see the other doctor on call and both go off. Each txn
+// pauses after its reads, so that the two overlap.
+class GoOffCall : public Txn {
+ public:
+  GoOffCall(Key me, Key other) : me_(me), other_(other) {
+    readset_.insert(other);
+    writeset_.insert(me);
+  }
+
+  GoOffCall* clone() const {
+    GoOffCall* clone = new GoOffCall(me_, other_);
+    this->CopyTxnInternals(clone);
+    return clone;
+  }
+
+  virtual void Run() {
+    Value me = 0, other = 0;
+    Read(me_, &me);
+    Read(other_, &other);
+    usleep(1000);
+    if (me + other == 2)
+      Write(me_, 0);
+    COMMIT;
+  }
+
+ private:
+  Key me_;
+  Key other_;
+};
+
+TEST(TxnProcessor_SSIPreventsWriteSkew) {
+  TxnProcessor p(SSI);
+  map<Key, Value> on_call;
+  for (Key k = 0; k < 2 * 100; k++)
+    on_call[k] = 1;
+  p.NewTxnRequest(new Put(on_call));
+  delete p.GetTxnResult();
+
+  // Both doctors of each pair try to go off call at once.
+  for (Key k = 0; k < 2 * 100; k += 2) {
+    p.NewTxnRequest(new GoOffCall(k, k + 1));
+    p.NewTxnRequest(new GoOffCall(k + 1, k));
+  }
+  int committed = 0;
+  for (int i = 0; i < 2 * 100; i++) {
+    Txn* txn = p.GetTxnResult();
+    if (txn->Status() == COMMITTED)
+      committed++;
+    delete txn;
+  }
+  EXPECT_EQ(2 * 100, committed);
+
+  // Exactly one doctor of each pair is still on call.
+  MVCCStorage* storage = static_cast<MVCCStorage*>(p.storage_);
+  uint64 snapshot = p.timestamps_.Peek();
+  int broken = 0;
+  for (Key k = 0; k < 2 * 100; k += 2) {
+    Value a = 0, b = 0;
+    storage->ReadSnapshot(k, &a, snapshot);
+    storage->ReadSnapshot(k + 1, &b, snapshot);
+    if (a + b != 1)
+      broken++;
+  }
+  EXPECT_EQ(0, broken);
+
+  END;
+}
+
+int main(int argc, char** argv) {
+  MVCCStorage_ReadSnapshotLeavesReadTimestamps();
+  MVCCStorage_NewerWrites();
+  MVCCStorage_HasConcurrentReaders();
+  TxnProcessor_MVCCReadOnlySnapshots();
+  TxnProcessor_SSIPreventsWriteSkew();
+}
@@ -0,0 +1,93 @@
+
+#include "txn/silo_storage.h"
+
+#include <sched.h>
+
+SiloStorage::SiloStorage() {}
+
+bool SiloStorage::Read(Key key, Value* result, uint64 txn_unique_id) {
+  uint64 tid;
+  return ReadStable(key, result, &tid);
+}
+
+// Lock the record, then install the value under an unchanged TID.
+void SiloStorage::Write(Key key, Value value, uint64 txn_unique_id) {
+  LockRecord(key);
+  SiloRecord* record = table_.Lookup(key);
+  InstallAndUnlock(key, value, record->tid_.load() & ~SILO_LOCK_BIT);
+}
+
+uint64 SiloStorage::RecordVersion(Key key) {
+  return RecordTid(key) & ~SILO_LOCK_BIT;
+}
+
+bool SiloStorage::ReadStable(Key key, Value* result, uint64* tid) {
+  SiloRecord* record = table_.Lookup(key);
+  if (record == NULL) {
+    *tid = 0;
+    return false;
+  }
+
+  while (true) {
+    uint64 before = record->tid_.load(std::memory_order_acquire);
+    if (before & SILO_LOCK_BIT) {
+      // A writer is installing a new value; let it finish.
+      sched_yield();
+      continue;
+    }
+    Value value = record->value_;
+    bool exists = record->exists_;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record->tid_.load(std::memory_order_relaxed) == before) {
+      *tid = before;
+      if (exists)
+        *result = value;
+      return exists;
+    }
+  }
+}
+
+uint64 SiloStorage::RecordTid(Key key) {
+  SiloRecord* record = table_.Lookup(key);
+  if (record == NULL)
+    return 0;
+  return record->tid_.load();
+}
+
+void SiloStorage::LockRecord(Key key) {
+  SiloRecord* record = table_.LookupOrCreate(key);
+  while (true) {
+    uint64 tid = record->tid_.load(std::memory_order_relaxed);
+    if (!(tid & SILO_LOCK_BIT) &&
+        record->tid_.compare_exchange_weak(tid, tid | SILO_LOCK_BIT,
+                                           std::memory_order_acquire))
+      return;
+    sched_yield();
+  }
+}
+
+void SiloStorage::UnlockRecord(Key key) {
+  table_.Lookup(key)->tid_.fetch_and(~SILO_LOCK_BIT, std::memory_order_release);
+}
+
+void SiloStorage::InstallAndUnlock(Key key, Value value, uint64 tid) {
+  SiloRecord* record = table_.Lookup(key);
+  record->value_ = value;
+  record->exists_ = true;
+  record->tid_.store(tid & ~SILO_LOCK_BIT, std::memory_order_release);
+}
+
+bool SiloStorage::CompareAndSwapTid(Key key, uint64 expected, uint64 desired) {
+  SiloRecord* record = table_.Lookup(key);
+  if (record == NULL)
+    return false;
+  return record->tid_.compare_exchange_strong(expected, desired);
+}
+
+// Create every key in the dense range with value 0 and TID 0, i.e. older than
+// any committed txn.
+void SiloStorage::InitStorage() {
+  table_.Init(DENSE_KEY_RANGE);
+}
+
+SiloStorage::~SiloStorage() {}
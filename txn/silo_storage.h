@@ -0,0 +1,77 @@
+
+#ifndef _SILO_STORAGE_H_
+#define _SILO_STORAGE_H_
+
+#include <atomic>
+
+#include "txn/storage.h"
+#include "txn/dense_storage.h"
+
+// Layout of a record's TID word: bit 0 is the lock bit, bits 1 to 31 are a
+// sequence number within the epoch, and bits 32 to 63 are the epoch.
+#define SILO_LOCK_BIT 1ULL
+#define SILO_SEQUENCE_STEP 2ULL
+#define SILO_EPOCH_SHIFT 32
+
+// TICTOC mode keeps a different word in the same slot: bit 0 is still the lock
+// bit, bits 1 to 15 hold 'delta' = rts - wts, and bits 16 to 63 hold the write
+// timestamp 'wts'.
+#define TICTOC_DELTA_SHIFT 1
+#define TICTOC_DELTA_MAX ((1ULL << 15) - 1)
+#define TICTOC_WTS_SHIFT 16
+
+// A single record slot for SILO mode. The TID word is the id of the txn that
+// last wrote the record, plus a lock bit held by a committing writer.
+struct SiloRecord {
+  std::atomic<uint64> tid_;  // TID of the last writer, with the lock bit
+  Value value_;              // Current value of the record
+  bool exists_;              // False until the record is first written
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// Single-version storage for SILO and TICTOC modes. Like DenseStorage, it keeps
+// its records in a DenseTable, but every record carries a TID word so that
+// workers can lock, validate and install records without any global
+// structure.
+class SiloStorage : public Storage {
+ public:
+  SiloStorage();
+
+  virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
+
+  virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
+
+  virtual uint64 RecordVersion(Key key);
+
+  virtual void InitStorage();
+
+  virtual ~SiloStorage();
+
+  // Reads a consistent <value, TID> pair for 'key', waiting out any writer
+  // that holds the record's lock. Sets '*tid' to 0 if the record does not
+  // exist. Returns true iff the record exists.
+  bool ReadStable(Key key, Value* result, uint64* tid);
+
+  // Returns the record's current TID word, including the lock bit.
+  uint64 RecordTid(Key key);
+
+  // Spins until the calling thread holds the record's lock.
+  void LockRecord(Key key);
+
+  // Releases the record's lock without changing it.
+  void UnlockRecord(Key key);
+
+  // Writes 'value' into a record locked by the caller, sets its TID to 'tid'
+  // and releases the lock, all visible to readers at once.
+  void InstallAndUnlock(Key key, Value value, uint64 tid);
+
+  // Atomically replaces the record's TID word with 'desired' if it is still
+  // 'expected' (lock bit included). Returns true iff it was replaced.
+  bool CompareAndSwapTid(Key key, uint64 expected, uint64 desired);
+
+ private:
+  friend class TxnProcessor;
+
+  DenseTable<SiloRecord> table_;
+};
+
+#endif  // _SILO_STORAGE_H_
@@ -1,7 +1,7 @@
 
 #include "txn/storage.h"
 
-bool Storage::Read(Key key, Value* result, int txn_unique_id) {
+bool Storage::Read(Key key, Value* result, uint64 txn_unique_id) {
   if (data_.count(key)) {
     *result = data_[key];
     return true;
@@ -10,16 +10,23 @@ bool Storage::Read(Key key, Value* result, int txn_unique_id) {
   }
 }
 
-// Write value and timestamps
-void Storage::Write(Key key, Value value, int txn_unique_id) {
+// Write value, then bump the record's version.
+void Storage::Write(Key key, Value value, uint64 txn_unique_id) {
   data_[key] = value;
-  timestamps_[key] = GetTime();
+  std::atomic_thread_fence(std::memory_order_release);
+  versions_[key]++;
 }
 
-double Storage::Timestamp(Key key) {
-  if (timestamps_.count(key) == 0)
+uint64 Storage::RecordVersion(Key key) {
+  if (versions_.count(key) == 0)
     return 0;
-  return timestamps_[key];
+  return versions_[key];
+}
+
+bool Storage::ReadVersioned(Key key, Value* result, uint64* version) {
+  *version = RecordVersion(key);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return Read(key, result);
 }
 
 // Init the storage
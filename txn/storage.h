@@ -6,11 +6,11 @@
 #include <tr1/unordered_map>
 #include <deque>
 #include <map>
+#include <atomic>
 
 #include "txn/common.h"
 #include "txn/txn.h"
 #include "utils/mutex.h"
-#include "txn/cluster.h"
 
 using std::tr1::unordered_map;
 using std::deque;
@@ -22,16 +22,22 @@ class Storage {
   // If there exists a record for the specified key, sets '*result' equal to
   // the value associated with the key and returns true, else returns false;
   // Note that the third parameter is only used for MVCC, the default vaule is 0.
-  virtual bool Read(Key key, Value* result, int txn_unique_id = 0);
+  virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
 
   // Inserts the record <key, value>, replacing any previous record with the
   // same key.
   // Note that the third parameter is only used for MVCC, the default vaule is 0.
-  virtual void Write(Key key, Value value, int txn_unique_id = 0);
+  virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
 
-  // Returns the timestamp at which the record with the specified key was last
-  // updated (returns 0 if the record has never been updated). This is used for OCC.
-  virtual double Timestamp(Key key);
+  // Returns the version of the record with the specified key, i.e. the number
+  // of times it has been written (0 if it has never been written). This is
+  // used for OCC.
+  virtual uint64 RecordVersion(Key key);
+
+  // Same as Read, but also sets '*version' to the version of the value read.
+  // The version is read before the value, so a concurrent Write can only make
+  // '*version' look older than the value, never newer. This is used for OCC.
+  virtual bool ReadVersioned(Key key, Value* result, uint64* version);
   
   // Init storage
   virtual void InitStorage();
@@ -43,11 +49,7 @@ class Storage {
   
   virtual void Unlock(Key key) {}
   
-  virtual bool CheckWrite (Key key, int txn_unique_id) {return true;}
-
-  virtual Cluster* getCluster(Key key) {return NULL;}
-
-  virtual uintptr_t getM() {return 0;}
+  virtual bool CheckWrite (Key key, uint64 txn_unique_id) {return true;}
    
  private:
  
@@ -56,8 +58,8 @@ class Storage {
    // Collection of <key, value> pairs. Use this for single-version storage
    unordered_map<Key, Value> data_;
   
-   // Timestamps at which each key was last updated.
-   unordered_map<Key, double> timestamps_;
+   // Number of times each key has been written.
+   unordered_map<Key, uint64> versions_;
 };
 
 #endif  // _STORAGE_H_
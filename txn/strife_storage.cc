@@ -1,45 +1,89 @@
+
 #include "txn/strife_storage.h"
 
+StrifeStorage::StrifeStorage() : clusters_(NULL) {}
 
+bool StrifeStorage::Read(Key key, Value* result, uint64 txn_unique_id) {
+  if (key >= STRIFE_KEY_RANGE)
+    return false;
+  *result = clusters_[key].value_;
+  return true;
+}
 
-bool StrifeStorage::Read(Key key, Value* result, int txn_unique_id) {
-    if (clusters_.count(key)) {
-        *result = clusters_[key]->value;
-        return true;
-    } else
-        return false;
+void StrifeStorage::Write(Key key, Value value, uint64 txn_unique_id) {
+  clusters_[Slot(key)].value_ = value;
 }
 
-void StrifeStorage::Write(Key key, Value value, int txn_unique_id) {
-    clusters_[key]->value = value;
+// Allocate the cluster table, with every key holding its own value and in a
+// cluster of its own.
+void StrifeStorage::InitStorage() {
+  clusters_ = new Cluster[STRIFE_KEY_RANGE];
+  for (uint32 i = 0; i < STRIFE_KEY_RANGE; i++) {
+    clusters_[i].value_ = i;
+    Reset(i);
+  }
 }
 
-Cluster* StrifeStorage::getCluster(Key key) {
-    return clusters_[key];
+void StrifeStorage::Reset(uint32 slot) {
+  Cluster* c = &clusters_[slot];
+  c->parent_.store(slot, std::memory_order_relaxed);
+  c->special_ = CLUSTER_NOT_SPECIAL;
+  c->count_.store(0, std::memory_order_relaxed);
 }
 
-uintptr_t StrifeStorage::getM() {
-    return M;
+// Parents always rank above their children, so pointing a slot at any
+// ancestor keeps the forest intact. 'root' may have been linked under another
+// root meanwhile, and other threads may have pointed slots on the path past
+// it, so the path is only compressed up to 'root''s rank: pointing a slot
+// that already sits above 'root' back at it would close a cycle.
+uint32 StrifeStorage::Find(uint32 slot) {
+  uint32 root = slot;
+  uint32 parent;
+  while ((parent = clusters_[root].parent_.load()) != root)
+    root = parent;
+
+  uint64 rank = Rank(root);
+  while (Rank(slot) < rank) {
+    parent = clusters_[slot].parent_.load();
+    if (Rank(parent) < rank)
+      clusters_[slot].parent_.compare_exchange_strong(parent, root);
+    slot = parent;
+  }
+  return root;
 }
 
-void StrifeStorage::InitStorage() {
-    for (int i = 0; i < 1000011;i++) {
-        Cluster *c = new Cluster();
-        c->value = i;
-        c->parent = c;
-        c->address = reinterpret_cast<uintptr_t>(c);
-        if (c->address > M)
-            M = c->address;
-        c->count = 0;
-        clusters_[i] = c;
-    } 
+uint32 StrifeStorage::Union(uint32 a, uint32 b) {
+  return Link(a, b, false);
 }
 
-StrifeStorage::~StrifeStorage() {
-    for (auto it = clusters_.begin(); it != clusters_.end(); ++it) {
-        delete it->second;
-    }
-    clusters_.clear();
+uint32 StrifeStorage::MergeSpecials(uint32 a, uint32 b) {
+  return Link(a, b, true);
 }
 
+// Links the lower ranked root under the other one. The CAS fails if the
+// lower root stopped being a root meanwhile, in which case both are looked
+// up again.
+uint32 StrifeStorage::Link(uint32 a, uint32 b, bool specials) {
+  while (true) {
+    uint32 parent = Find(a);
+    uint32 child = Find(b);
+    if (parent == child)
+      return parent;
+    if (!specials && clusters_[parent].special_ != CLUSTER_NOT_SPECIAL &&
+        clusters_[child].special_ != CLUSTER_NOT_SPECIAL)
+      return parent;
+
+    if (Rank(parent) < Rank(child)) {
+      uint32 temp = parent;
+      parent = child;
+      child = temp;
+    }
+    uint32 expected = child;
+    if (clusters_[child].parent_.compare_exchange_strong(expected, parent))
+      return parent;
+  }
+}
 
+StrifeStorage::~StrifeStorage() {
+  delete[] clusters_;
+}
@@ -5,44 +5,77 @@
 #include "txn/storage.h"
 #include "txn/cluster.h"
 
-using std::tr1::unordered_map;
-using std::deque;
-using std::map;
-
+// Number of keys that InitStorage() creates, i.e. keys [0, STRIFE_KEY_RANGE).
+// A key's slot in the cluster table is the key itself.
+#define STRIFE_KEY_RANGE 1000011
+
+// Storage for the Strife modes: one contiguous table of Clusters indexed by
+// key, holding both the values and the union-find forest that partitions each
+// batch. Union-find links a root to the root that ranks higher: special
+// clusters rank above all others, in spot order, and the rest by slot.
 class StrifeStorage : public Storage {
  public:
+  StrifeStorage();
+
+  virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
 
-  virtual bool Read(Key key, Value* result, int txn_unique_id = 0);
+  virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
 
-  virtual void Write(Key key, Value value, int txn_unique_id = 0);
+  virtual uint64 RecordVersion(Key key) {return 0;}
 
- 
-  virtual double Timestamp(Key key) {return 0;}
-  
   virtual void InitStorage();
-  
+
   virtual void Lock(Key key) {}
-  
 
   virtual void Unlock(Key key) {}
-  
 
-  virtual bool CheckWrite (Key key, int txn_unique_id) {return true;}
-  
+  virtual bool CheckWrite (Key key, uint64 txn_unique_id) {return true;}
+
   virtual ~StrifeStorage();
 
-  virtual Cluster* getCluster(Key key);
+  // Returns the slot of 'key'. Dies if 'key' is out of range.
+  inline uint32 Slot(Key key) {
+    if (key >= STRIFE_KEY_RANGE)
+      DIE("Strife key out of range: " << key);
+    return static_cast<uint32>(key);
+  }
+
+  inline Cluster* GetCluster(uint32 slot) {
+    return &clusters_[slot];
+  }
 
-  virtual uintptr_t getM();
+  // Makes 'slot' a cluster of its own again, as at the start of a batch.
+  void Reset(uint32 slot);
+
+  // Returns the root of the cluster containing 'slot', pointing the slots on
+  // the way directly at it.
+  uint32 Find(uint32 slot);
+
+  // Merges the clusters containing 'a' and 'b' and returns the root of the
+  // result. Two special clusters are never merged; the root of 'a''s is
+  // returned instead.
+  uint32 Union(uint32 a, uint32 b);
+
+  // Same as Union, but also merges two special clusters, as the merge step
+  // does for specials that conflict often enough.
+  uint32 MergeSpecials(uint32 a, uint32 b);
 
  private:
- 
-  friend class TxnProcessor;
+  // Union, merging two special clusters only if 'specials' is true.
+  uint32 Link(uint32 a, uint32 b, bool specials);
 
-  unordered_map<Key, Cluster*> clusters_;
+  friend class TxnProcessor;
 
-  uintptr_t M=0;
+  // Rank of 'slot' for Union. Parents rank above their children.
+  inline uint64 Rank(uint32 slot) {
+    int32 special = clusters_[slot].special_;
+    if (special == CLUSTER_NOT_SPECIAL)
+      return slot;
+    return STRIFE_KEY_RANGE + static_cast<uint64>(special);
+  }
 
+  // A slot for each key in [0, STRIFE_KEY_RANGE).
+  Cluster* clusters_;
 };
 
-#endif  // _MVCC_STORAGE_H_
+#endif  // _STRIFE_STORAGE_H_
@@ -0,0 +1,172 @@
+
+#include "txn/strife_tuner.h"
+
+// Parameters before the first batch: the batch window and alpha that the
+// benchmarks used to hard-code, and a k in the middle of the range the sweeps
+// found good.
+#define STRIFE_INITIAL_DURATION 0.001
+#define STRIFE_INITIAL_K 20
+#define STRIFE_INITIAL_ALPHA 0.2
+
+// Bounds and steps of the parameters. The window is stepped by a factor, the
+// others by an amount.
+#define STRIFE_MIN_DURATION 0.0001
+#define STRIFE_MAX_DURATION 0.01
+#define STRIFE_DURATION_STEP 1.25
+#define STRIFE_MIN_K 5
+#define STRIFE_MAX_K 100
+#define STRIFE_K_STEP 5
+#define STRIFE_MIN_ALPHA 0.05
+#define STRIFE_MAX_ALPHA 0.95
+#define STRIFE_ALPHA_STEP 0.05
+
+// Weight of the newest batch in the moving averages.
+#define STRIFE_TUNER_WEIGHT 0.25
+
+StrifeTuner::StrifeTuner(int threads)
+    : threads_(threads), param_(STRIFE_DURATION), probing_(false), saved_(0),
+      baseline_(0), window_batches_(0), window_txns_(0),
+      window_start_(GetTime()), residual_ratio_(-1), clusters_(-1),
+      overhead_(-1) {
+  values_[STRIFE_DURATION] = STRIFE_INITIAL_DURATION;
+  values_[STRIFE_K] = STRIFE_INITIAL_K;
+  values_[STRIFE_ALPHA] = STRIFE_INITIAL_ALPHA;
+  for (int i = 0; i < STRIFE_PARAMS; i++) {
+    directions_[i] = 1;
+    failed_[i] = 0;
+  }
+}
+
+// Folds 'sample' into the moving average '*average'.
+static void Fold(double* average, double sample) {
+  if (*average < 0)
+    *average = sample;
+  else
+    *average += STRIFE_TUNER_WEIGHT * (sample - *average);
+}
+
+void StrifeTuner::Record(const StrifeBatchStats& stats) {
+  if (stats.txns_ == 0)
+    return;
+  double total = stats.analyze_time_ + stats.run_time_;
+
+  mutex_.Lock();
+  Fold(&residual_ratio_, static_cast<double>(stats.residuals_) / stats.txns_);
+  Fold(&clusters_, stats.clusters_);
+  if (total > 0)
+    Fold(&overhead_, stats.analyze_time_ / total);
+
+  window_batches_++;
+  window_txns_ += stats.txns_;
+  double now = GetTime();
+  if (window_batches_ < STRIFE_TUNER_WINDOW || now <= window_start_) {
+    mutex_.Unlock();
+    return;
+  }
+  double throughput = window_txns_ / (now - window_start_);
+  window_batches_ = 0;
+  window_txns_ = 0;
+  window_start_ = now;
+
+  if (!probing_) {
+    // Just measured the current configuration; try a step from it.
+    baseline_ = throughput;
+    Probe(param_);
+  } else if (throughput >= baseline_) {
+    // The step paid off; try another one.
+    baseline_ = throughput;
+    failed_[param_] = 0;
+    Probe(param_);
+  } else {
+    // Undo the step and measure again before tuning the next parameter,
+    // since the workload may have shifted meanwhile.
+    values_[param_] = saved_;
+    failed_[param_] = directions_[param_];
+    directions_[param_] = -directions_[param_];
+    param_ = (param_ + 1) % STRIFE_PARAMS;
+    probing_ = false;
+  }
+  mutex_.Unlock();
+}
+
+int StrifeTuner::Hint(int param) {
+  switch (param) {
+    case STRIFE_DURATION:
+      if (overhead_ > STRIFE_HIGH_OVERHEAD)
+        return 1;
+      if (overhead_ < STRIFE_LOW_OVERHEAD &&
+          residual_ratio_ > STRIFE_HIGH_RESIDUALS)
+        return -1;
+      return 0;
+    case STRIFE_K:
+      if (clusters_ < threads_)
+        return 1;
+      if (residual_ratio_ < STRIFE_LOW_RESIDUALS)
+        return -1;
+      return 0;
+    default:
+      if (residual_ratio_ > STRIFE_HIGH_RESIDUALS)
+        return -1;
+      if (residual_ratio_ < STRIFE_LOW_RESIDUALS && clusters_ < threads_)
+        return 1;
+      return 0;
+  }
+}
+
+void StrifeTuner::Probe(int param) {
+  int hint = Hint(param);
+  if (hint != 0 && hint != failed_[param])
+    directions_[param] = hint;
+
+  double value = values_[param];
+  double min, max;
+  switch (param) {
+    case STRIFE_DURATION:
+      value = directions_[param] > 0 ? value * STRIFE_DURATION_STEP
+                                     : value / STRIFE_DURATION_STEP;
+      min = STRIFE_MIN_DURATION;
+      max = STRIFE_MAX_DURATION;
+      break;
+    case STRIFE_K:
+      value += directions_[param] * STRIFE_K_STEP;
+      min = STRIFE_MIN_K;
+      max = STRIFE_MAX_K;
+      break;
+    default:
+      value += directions_[param] * STRIFE_ALPHA_STEP;
+      min = STRIFE_MIN_ALPHA;
+      max = STRIFE_MAX_ALPHA;
+  }
+
+  if (value < min - 1e-9 || value > max + 1e-9) {
+    directions_[param] = -directions_[param];
+    param_ = (param + 1) % STRIFE_PARAMS;
+    probing_ = false;
+    return;
+  }
+  saved_ = values_[param];
+  values_[param] = value;
+  param_ = param;
+  probing_ = true;
+}
+
+double StrifeTuner::Duration() {
+  mutex_.Lock();
+  double duration = values_[STRIFE_DURATION];
+  mutex_.Unlock();
+  return duration;
+}
+
+int StrifeTuner::K() {
+  mutex_.Lock();
+  int k = static_cast<int>(values_[STRIFE_K] + 0.5);
+  mutex_.Unlock();
+  return k;
+}
+
+double StrifeTuner::Alpha() {
+  mutex_.Lock();
+  double alpha = values_[STRIFE_ALPHA];
+  mutex_.Unlock();
+  return alpha;
+}
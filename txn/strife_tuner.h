@@ -0,0 +1,110 @@
+
+#ifndef _STRIFE_TUNER_H_
+#define _STRIFE_TUNER_H_
+
+#include "txn/common.h"
+#include "utils/mutex.h"
+
+// Parameters a StrifeTuner adjusts, probed in this order.
+#define STRIFE_DURATION 0  // Batch window, in seconds
+#define STRIFE_K 1         // Number of spot samples
+#define STRIFE_ALPHA 2     // Merge threshold
+#define STRIFE_PARAMS 3
+
+// Number of batches over which the tuner measures the throughput of a
+// configuration.
+#define STRIFE_TUNER_WINDOW 16
+
+// Residual ratios above which the tuner tries to shrink the residual phase,
+// and below which it considers it cheap.
+#define STRIFE_HIGH_RESIDUALS 0.3
+#define STRIFE_LOW_RESIDUALS 0.1
+
+// Share of a batch's time spent analyzing it above which the tuner first
+// tries a longer batch window, and below which it may try a shorter one.
+#define STRIFE_HIGH_OVERHEAD 0.5
+#define STRIFE_LOW_OVERHEAD 0.1
+
+// What a Strife batch looked like, as measured by the TxnProcessor.
+struct StrifeBatchStats {
+  int txns_;              // Txns in the batch
+  int residuals_;         // Txns left to the residual phase
+  int clusters_;          // Conflict-free clusters
+  double analyze_time_;   // Seconds spent partitioning the batch
+  double run_time_;       // Seconds spent running it
+};
+
+// Online controller for the Strife batch window, the number 'k' of spot
+// samples and the merge threshold 'alpha'. It hill-climbs one parameter at a
+// time: it measures the throughput of the current configuration over
+// STRIFE_TUNER_WINDOW batches, steps the parameter, and measures again. A step
+// that did not lower throughput is kept and followed by another one in the
+// same direction; a step that did is undone, and the tuner moves on to the
+// next parameter.
+//
+// The batches' stats decide which way a parameter is first stepped:
+//  - a longer window while analysis takes more than STRIFE_HIGH_OVERHEAD of
+//    the batch time, and a shorter one while analysis is cheap but many txns
+//    end up residual;
+//  - more spot samples while there are fewer clusters than worker threads,
+//    and fewer while there are enough clusters and hardly any residuals;
+//  - a lower alpha, i.e. more merging of special clusters, while many txns
+//    span them, and a higher one while residuals are rare but clusters too
+//    few to keep the workers busy.
+// A direction that just failed is not retried on the stats' say-so alone.
+//
+// Safe to call from several threads, e.g. the STRIFE_PIPELINED scheduler
+// reading the parameters while the executor records batches.
+class StrifeTuner {
+ public:
+  explicit StrifeTuner(int threads);
+
+  // Folds the stats of a finished batch in, and at the end of a window
+  // adjusts the parameters.
+  void Record(const StrifeBatchStats& stats);
+
+  // Current parameters.
+  double Duration();
+  int K();
+  double Alpha();
+
+ private:
+  // Returns the direction (+1 or -1) the batch stats suggest for 'param', or
+  // 0 if they suggest none.
+  int Hint(int param);
+
+  // Steps 'param' in its current direction and starts measuring the result.
+  // If the parameter is at its bound, turns it around and moves on instead.
+  void Probe(int param);
+
+  // Number of worker threads, i.e. the clusters needed to keep them busy.
+  int threads_;
+
+  Mutex mutex_;
+
+  // Current value, direction of the next step, and direction that last
+  // failed (or 0) of each parameter.
+  double values_[STRIFE_PARAMS];
+  int directions_[STRIFE_PARAMS];
+  int failed_[STRIFE_PARAMS];
+
+  // Parameter being tuned. While 'probing_', it has just been stepped from
+  // 'saved_', and 'baseline_' is the throughput from before the step.
+  int param_;
+  bool probing_;
+  double saved_;
+  double baseline_;
+
+  // Batches and txns recorded in the current window, and its start time.
+  int window_batches_;
+  int window_txns_;
+  double window_start_;
+
+  // Moving averages of the residual ratio, the cluster count and the share of
+  // batch time spent analyzing. Negative until the first batch.
+  double residual_ratio_;
+  double clusters_;
+  double overhead_;
+};
+
+#endif  // _STRIFE_TUNER_H_
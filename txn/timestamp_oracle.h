@@ -0,0 +1,75 @@
+
+#ifndef _TIMESTAMP_ORACLE_H_
+#define _TIMESTAMP_ORACLE_H_
+
+#include <atomic>
+
+#include "txn/common.h"
+
+// Number of timestamps a thread takes from the oracle at once when using
+// NextLeased().
+#define TIMESTAMP_LEASE_SIZE 64
+
+/// @class TimestampOracle
+///
+/// Hands out unique, 64-bit logical timestamps (txn unique ids) without
+/// taking any lock. Next() returns a timestamp larger than every timestamp
+/// handed out before the call began; Reserve(n) hands out n consecutive
+/// timestamps with a single atomic add.
+///
+/// NextLeased() lets a thread reserve a range of TIMESTAMP_LEASE_SIZE
+/// timestamps and then hand them out locally, so that threads allocating at a
+/// high rate do not all contend on the oracle's counter. Leased timestamps are
+/// unique but not globally ordered across threads, so callers that need a
+/// timestamp newer than everything seen so far (e.g. MVCC restarts) must use
+/// Next().
+class TimestampOracle {
+ public:
+  explicit TimestampOracle(uint64 first = 1) : next_(first) {}
+
+  // Returns a fresh timestamp.
+  inline uint64 Next() {
+    return next_.fetch_add(1);
+  }
+
+  // Reserves 'n' consecutive timestamps and returns the first one.
+  inline uint64 Reserve(uint64 n) {
+    return next_.fetch_add(n);
+  }
+
+  // Returns a fresh timestamp from the calling thread's lease, taking a new
+  // lease from the oracle when the current one is used up.
+  inline uint64 NextLeased() {
+    Lease& lease = LocalLease();
+    if (lease.oracle_ != this || lease.next_ == lease.end_) {
+      lease.oracle_ = this;
+      lease.next_ = Reserve(TIMESTAMP_LEASE_SIZE);
+      lease.end_ = lease.next_ + TIMESTAMP_LEASE_SIZE;
+    }
+    return lease.next_++;
+  }
+
+  // Returns the timestamp the next call to Next() would return if no other
+  // thread got there first.
+  inline uint64 Peek() const {
+    return next_.load();
+  }
+
+ private:
+  struct Lease {
+    const TimestampOracle* oracle_;
+    uint64 next_;
+    uint64 end_;
+  };
+
+  // The calling thread's lease. A thread holds a lease on at most one oracle
+  // at a time; switching oracles abandons the rest of the old lease.
+  static Lease& LocalLease() {
+    static __thread Lease lease = {NULL, 0, 0};
+    return lease;
+  }
+
+  std::atomic<uint64> next_;
+};
+
+#endif  // _TIMESTAMP_ORACLE_H_
@@ -12,8 +12,9 @@ bool Txn::Read(const Key& key, Value* value) {
 
   // 'reads_' has already been populated by TxnProcessor, so it should contain
   // the target value iff the record appears in the database.
-  if (reads_.count(key)) {
-    *value = reads_[key];
+  KeyValueMap::iterator it = reads_.find(key);
+  if (it != reads_.end()) {
+    *value = it->second;
     return true;
   } else {
     return false;
@@ -38,7 +39,7 @@ void Txn::Write(const Key& key, const Value& value) {
 }
 
 void Txn::CheckReadWriteSets() {
-  for (set<Key>::iterator it = writeset_.begin();
+  for (KeySet::iterator it = writeset_.begin();
        it != writeset_.end(); ++it) {
     if (readset_.count(*it) > 0) {
       DIE("Overlapping read/write sets\n.");
@@ -47,11 +48,12 @@ void Txn::CheckReadWriteSets() {
 }
 
 void Txn::CopyTxnInternals(Txn* txn) const {
-  txn->readset_ = set<Key>(this->readset_);
-  txn->writeset_ = set<Key>(this->writeset_);
-  txn->reads_ = map<Key, Value>(this->reads_);
-  txn->writes_ = map<Key, Value>(this->writes_);
+  txn->readset_ = this->readset_;
+  txn->writeset_ = this->writeset_;
+  txn->reads_ = this->reads_;
+  txn->writes_ = this->writes_;
   txn->status_ = this->status_;
+  txn->read_only_ = this->read_only_;
   txn->unique_id_ = this->unique_id_;
-  txn->occ_start_time_ = this->occ_start_time_;
+  txn->read_versions_ = this->read_versions_;
 }
@@ -7,11 +7,40 @@
 #include <vector>
 
 #include "txn/common.h"
+#include "utils/flat_set.h"
+#include "utils/task.h"
 
 using std::map;
 using std::set;
 using std::vector;
 
+class Txn;
+class TxnProcessor;
+
+// Sorted key sets and key/value results of a txn. Both keep small sizes
+// inline, so building and scanning a typical txn's access set does not
+// allocate.
+typedef FlatSet<Key> KeySet;
+typedef FlatMap<Key, Value> KeyValueMap;
+typedef FlatMap<Key, uint64> KeyVersionMap;
+
+// Task running one TxnProcessor method on a txn. Every Txn embeds one, so that
+// dispatching the txn to the thread pool does not allocate; the pool leaves
+// it alone after Run().
+class TxnTask : public Task {
+ public:
+  TxnTask() : processor_(NULL), method_(NULL), txn_(NULL) {}
+
+  // Defined in txn_processor.cc.
+  virtual void Run();
+
+  virtual bool DeleteAfterRun() { return false; }
+
+  TxnProcessor* processor_;
+  void (TxnProcessor::*method_)(Txn*);
+  Txn* txn_;
+};
+
 // Txns can have five distinct status values:
 enum TxnStatus {
   INCOMPLETE = 0,   // Not yet executed
@@ -24,7 +53,7 @@ enum TxnStatus {
 class Txn {
  public:
   // Commit vote defauls to false. Only by calling "commit"
-  Txn() : status_(INCOMPLETE) {}
+  Txn() : status_(INCOMPLETE), read_only_(false) {}
   virtual ~Txn() {}
   virtual Txn * clone() const = 0;    // Virtual constructor (copying)
 
@@ -34,6 +63,10 @@ class Txn {
   // Returns the Txn's current execution status.
   TxnStatus Status() { return status_; }
 
+  // Returns true if the txn never writes: it either declared so up front or
+  // has an empty writeset.
+  bool ReadOnly() const { return read_only_ || writeset_.empty(); }
+
   // Checks for overlap in read and write sets. If any key appears in both,
   // an error occurs.
   void CheckReadWriteSets();
@@ -83,25 +116,37 @@ class Txn {
 
   // Set of all keys that may need to be read in order to execute the
   // transaction.
-  set<Key> readset_;
+  KeySet readset_;
 
   // Set of all keys that may be updated when executing the transaction.
-  set<Key> writeset_;
+  KeySet writeset_;
 
   // Results of reads performed by the transaction.
-  map<Key, Value> reads_;
+  KeyValueMap reads_;
 
   // Key, Value pairs WRITTEN by the transaction.
-  map<Key, Value> writes_;
+  KeyValueMap writes_;
 
   // Transaction's current execution status.
   TxnStatus status_;
 
+  // Set by txns that declare up front that they are read-only (see ReadOnly()).
+  bool read_only_;
+
   // Unique, monotonically increasing transaction ID, assigned by TxnProcessor.
   uint64 unique_id_;
 
-  // Start time (used for OCC).
-  double occ_start_time_;
+  // Version of every record the txn read, captured at read time (used for
+  // OCC validation).
+  KeyVersionMap read_versions_;
+
+  // Task used by TxnProcessor to run this txn in its thread pool. Only valid
+  // while the txn is dispatched.
+  TxnTask task_;
+
+  // Position of the txn in the VLL scheduler's TxnQueue, counting every txn
+  // ever queued. Only valid while the txn is queued.
+  uint64 vll_position_;
 };
 
 #endif  // _TXN_H_
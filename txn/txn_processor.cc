@@ -1,6 +1,7 @@
 
 #include "txn/txn_processor.h"
 #include <stdio.h>
+#include <algorithm>
 #include <set>
 #include <random>
 #include <utility>
@@ -12,31 +13,70 @@ using namespace std;
 // Thread & queue counts for StaticThreadPool initialization.
 #define THREAD_COUNT 8
 
-typedef struct handler {
-  TxnProcessor *p;
-  vector<Txn*> *batch;
-} StrifeHandler;
+// Maximum number of version chains the MVCC garbage collector trims per round,
+// and the pause between rounds that find less work than that.
+#define MVCC_GC_BATCH 1024
+#define MVCC_GC_INTERVAL 0.001
+
+// Maximum number of txns the CALVIN scheduler sequences as one batch.
+#define CALVIN_BATCH_SIZE 1024
+
+// Maximum number of txns in the VLL scheduler's TxnQueue, and number of slots
+// in each of its hashed key bitmaps (a power of two).
+#define VLL_QUEUE_SIZE 512
+#define VLL_KEY_SLOTS 4096
+
+// Length of a SILO epoch in seconds.
+#define SILO_EPOCH_LENGTH 0.04
+
+TxnProcessor::TxnProcessor(CCMode mode, int k_, double alpha_,
+                           StorageMode storage_mode, ThreadPoolMode pool_mode)
+    : mode_(mode), running_(true), timestamps_(1), k(k_), alpha(alpha_),
+      strife_plans_(STRIFE_PLAN_QUEUE_CAPACITY),
+      txn_requests_(TXN_QUEUE_CAPACITY), completed_txns_(TXN_QUEUE_CAPACITY),
+      txn_results_(TXN_QUEUE_CAPACITY), vll_queue_front_(0),
+      vll_running_(0), vll_blocked_(0), vll_round_(0), mvcc_slot_count_(0),
+      mvcc_gc_bound_(0), silo_epoch_(1) {
+  if (pool_mode == WORK_STEALING_POOL)
+    tp_ = new WorkStealingThreadPool(THREAD_COUNT);
+  else
+    tp_ = new StaticThreadPool(THREAD_COUNT);
 
-TxnProcessor::TxnProcessor(CCMode mode, int k_, double alpha_)
-    : mode_(mode), tp_(THREAD_COUNT), next_unique_id_(1), k(k_), alpha(alpha_) {
   if (mode_ == LOCKING_EXCLUSIVE_ONLY)
     lm_ = new LockManagerA(&ready_txns_);
-  else if (mode_ == LOCKING || mode_ == STRIFE)
+  else if (mode_ == LOCKING || mode_ == CALVIN)
     lm_ = new LockManagerB(&ready_txns_);
+  else if (mode_ == P_LOCKING || mode_ == STRIFE || mode_ == STRIFE_PIPELINED)
+    concurrent_lm_ = new ConcurrentLockManager();
   
   // Create the storage
-  if (mode_ == MVCC) {
+  if (mode_ == MVCC || mode_ == SSI) {
     storage_ = new MVCCStorage();
-  } else if (mode_ == STRIFE) {
+  } else if (mode_ == STRIFE || mode_ == STRIFE_PIPELINED) {
     storage_ = new StrifeStorage();
+  } else if (mode_ == SILO || mode_ == TICTOC) {
+    storage_ = new SiloStorage();
+  } else if (storage_mode == DENSE_STORAGE || mode_ == VLL) {
+    storage_ = new DenseStorage();
   } else {
     storage_ = new Storage();
   }
   
   storage_->InitStorage();
 
-  if (mode_ == STRIFE)
-    M = storage_->getM();
+  strife_tuner_ = NULL;
+  if ((mode_ == STRIFE || mode_ == STRIFE_PIPELINED) && k <= 0)
+    strife_tuner_ = new StrifeTuner(THREAD_COUNT);
+
+  if (mode_ == VLL) {
+    vll_exclusive_keys_.resize(VLL_KEY_SLOTS, 0);
+    vll_shared_keys_.resize(VLL_KEY_SLOTS, 0);
+  }
+
+  for (int i = 0; i < MVCC_GC_SLOTS; i++) {
+    mvcc_slots_[i].ts_.store(0);
+    mvcc_slots_[i].snapshot_.store(0);
+  }
 
 
   // Start 'RunScheduler()' running.
@@ -48,14 +88,15 @@ TxnProcessor::TxnProcessor(CCMode mode, int k_, double alpha_)
     CPU_SET(i, &cpuset);
   } 
   pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
-  pthread_t scheduler_;
   pthread_create(&scheduler_, &attr, StartScheduler, reinterpret_cast<void*>(this));
-  
-  // if (mode_ == STRIFE) {
-  //   pthread_t scheduler_2;
-  //   pthread_create(&scheduler_2, &attr, StartStrife, reinterpret_cast<void*>(this));
-  // }
-  
+
+  if (mode_ == MVCC || mode_ == SSI)
+    pthread_create(&gc_thread_, &attr, StartGarbageCollection,
+                   reinterpret_cast<void*>(this));
+
+  if (mode_ == STRIFE_PIPELINED)
+    pthread_create(&strife_executor_, &attr, StartStrife,
+                   reinterpret_cast<void*>(this));
 }
 
 void* TxnProcessor::StartScheduler(void * arg) {
@@ -63,35 +104,78 @@ void* TxnProcessor::StartScheduler(void * arg) {
   return NULL;
 }
 
+void TxnTask::Run() {
+  (processor_->*method_)(txn_);
+}
+
+// Binds the task embedded in 'txn' to 'method' and hands it to the pool.
+void TxnProcessor::Dispatch(Txn* txn, void (TxnProcessor::*method)(Txn*)) {
+  txn->task_.processor_ = this;
+  txn->task_.method_ = method;
+  txn->task_.txn_ = txn;
+  tp_->RunTask(&txn->task_);
+}
+
 TxnProcessor::~TxnProcessor() {
-  if (mode_ == LOCKING_EXCLUSIVE_ONLY || mode_ == LOCKING || mode_ == STRIFE)
+  // Make the background loops exit and wait for them first, so that nothing
+  // hands the pool new tasks once it is stopping. Stopping the pool then lets
+  // the txns already dispatched finish before anything is freed.
+  running_.store(false);
+  pthread_join(scheduler_, NULL);
+  if (mode_ == MVCC || mode_ == SSI)
+    pthread_join(gc_thread_, NULL);
+  if (mode_ == STRIFE_PIPELINED) {
+    pthread_join(strife_executor_, NULL);
+    StrifePlan* plan;
+    while (strife_plans_.Pop(&plan))
+      delete plan;
+  }
+  tp_->Stop();
+  delete tp_;
+
+  if (mode_ == LOCKING_EXCLUSIVE_ONLY || mode_ == LOCKING || mode_ == CALVIN)
     delete lm_;
+  else if (mode_ == P_LOCKING || mode_ == STRIFE || mode_ == STRIFE_PIPELINED)
+    delete concurrent_lm_;
     
+  delete strife_tuner_;
   delete storage_;
 }
 
 void TxnProcessor::NewTxnRequest(Txn* txn) {
   // Atomically assign the txn a new number and add it to the incoming txn
   // requests queue.
-  mutex_.Lock();
-  txn->unique_id_ = next_unique_id_;
-  next_unique_id_++;
+  txn->unique_id_ = timestamps_.Next();
   txn_requests_.Push(txn);
-  mutex_.Unlock();
 }
 
-Txn* TxnProcessor::GetTxnResult() {
+void TxnProcessor::NewTxnRequests(const vector<Txn*>& txns) {
+  // Reserve a contiguous range of unique ids at once, then enqueue the whole
+  // batch.
+  uint64 first_id = timestamps_.Reserve(txns.size());
+  for (uint32 i = 0; i < txns.size(); i++)
+    txns[i]->unique_id_ = first_id + i;
+  txn_requests_.PushMany(txns.data(), txns.size());
+}
+
+Txn* TxnProcessor::GetTxnResult(double timeout) {
   Txn* txn;
-  // cout<<"started getting result"<<endl;
-  while (!txn_results_.Pop(&txn)) {
-    // No result yet. Wait a bit before trying again (to reduce contention on
-    // atomic queues).
-    sleep(0.000001);
-  }
-  // cout<<"finished getting result"<<endl;
+  if (!txn_results_.PopBlocking(&txn, timeout))
+    return NULL;
   return txn;
 }
 
+int TxnProcessor::GetTxnResults(vector<Txn*>* results, int max,
+                                double timeout) {
+  return txn_results_.PopMany(results, max, timeout);
+}
+
+MVCCGCStats TxnProcessor::GarbageCollectionStats() {
+  if (mode_ != MVCC && mode_ != SSI)
+    DIE("No MVCC garbage collection in mode " << mode_);
+  return static_cast<MVCCStorage*>(storage_)->GCStats();
+}
+
 void TxnProcessor::RunScheduler() {
   switch (mode_) {
     case SERIAL:                 RunSerialScheduler(); break;
@@ -100,13 +184,20 @@ void TxnProcessor::RunScheduler() {
     case OCC:                    RunOCCScheduler(); break;
     case P_OCC:                  RunOCCParallelScheduler(); break;
     case MVCC:                   RunMVCCScheduler(); break;
-    case STRIFE:                 RunStrifeScheduler();
+    case STRIFE:                 RunStrifeScheduler(); break;
+    case STRIFE_PIPELINED:       RunStrifeScheduler(); break;
+    case P_LOCKING:              RunParallelLockingScheduler(); break;
+    case SILO:                   RunSiloScheduler(); break;
+    case TICTOC:                 RunTicTocScheduler(); break;
+    case SSI:                    RunSSIScheduler(); break;
+    case CALVIN:                 RunCalvinScheduler(); break;
+    case VLL:                    RunVLLScheduler();
   }
 }
 
 void TxnProcessor::RunSerialScheduler() {
   Txn* txn;
-  while (tp_.Active()) {
+  while (running_.load()) {
     // Get next txn request.
     if (txn_requests_.Pop(&txn)) {
       // Execute txn.
@@ -131,19 +222,19 @@ void TxnProcessor::RunSerialScheduler() {
 
 void TxnProcessor::RunLockingScheduler() {
   Txn* txn;
-  while (tp_.Active()) {
+  while (running_.load()) {
     // Start processing the next incoming transaction request.
-    if (txn_requests_.Pop(&txn)) {
+    if (NextTxnRequest(&txn)) {
       bool blocked = false;
       // Request read locks.
-      for (set<Key>::iterator it = txn->readset_.begin();
+      for (KeySet::iterator it = txn->readset_.begin();
            it != txn->readset_.end(); ++it) {
         if (!lm_->ReadLock(txn, *it)) {
           blocked = true;
           // If readset_.size() + writeset_.size() > 1, and blocked, just abort
           if (txn->readset_.size() + txn->writeset_.size() > 1) {
             // Release all locks that already acquired
-            for (set<Key>::iterator it_reads = txn->readset_.begin(); true; ++it_reads) {
+            for (KeySet::iterator it_reads = txn->readset_.begin(); true; ++it_reads) {
               lm_->Release(txn, *it_reads);
               if (it_reads == it) {
                 break;
@@ -156,18 +247,18 @@ void TxnProcessor::RunLockingScheduler() {
           
       if (blocked == false) {
         // Request write locks.
-        for (set<Key>::iterator it = txn->writeset_.begin();
+        for (KeySet::iterator it = txn->writeset_.begin();
              it != txn->writeset_.end(); ++it) {
           if (!lm_->WriteLock(txn, *it)) {
             blocked = true;
             // If readset_.size() + writeset_.size() > 1, and blocked, just abort
             if (txn->readset_.size() + txn->writeset_.size() > 1) {
               // Release all read locks that already acquired
-              for (set<Key>::iterator it_reads = txn->readset_.begin(); it_reads != txn->readset_.end(); ++it_reads) {
+              for (KeySet::iterator it_reads = txn->readset_.begin(); it_reads != txn->readset_.end(); ++it_reads) {
                 lm_->Release(txn, *it_reads);
               }
               // Release all write locks that already acquired
-              for (set<Key>::iterator it_writes = txn->writeset_.begin(); true; ++it_writes) {
+              for (KeySet::iterator it_writes = txn->writeset_.begin(); true; ++it_writes) {
                 lm_->Release(txn, *it_writes);
                 if (it_writes == it) {
                   break;
@@ -184,17 +275,137 @@ void TxnProcessor::RunLockingScheduler() {
       if (blocked == false) {
         ready_txns_.push_back(txn);
       } else if (blocked == true && (txn->writeset_.size() + txn->readset_.size() > 1)){
-        mutex_.Lock();
-        txn->unique_id_ = next_unique_id_;
-        next_unique_id_++;
-        txn_requests_.Push(txn);
-        mutex_.Unlock(); 
+        txn->unique_id_ = timestamps_.NextLeased();
+        RestartTxn(txn);
       }
     }
 
     // Process and commit all transactions that have finished running.
+    FinishLockingTxns();
+
+    // Start executing all transactions that have newly acquired all their
+    // locks.
+    while (ready_txns_.size()) {
+      // Get next ready txn from the queue.
+      txn = ready_txns_.front();
+      ready_txns_.pop_front();
+
+      // Start txn running in its own thread.
+      Dispatch(txn, &TxnProcessor::ExecuteTxn);
+    }
+  }
+}
+
+void TxnProcessor::RestartTxn(Txn* txn) {
+  if (!txn_requests_.PushNonBlocking(txn))
+    restarted_txns_.push_back(txn);
+}
+
+bool TxnProcessor::NextTxnRequest(Txn** txn) {
+  if (restarted_txns_.empty())
+    return txn_requests_.Pop(txn);
+  *txn = restarted_txns_.front();
+  restarted_txns_.pop_front();
+  return true;
+}
+
+void TxnProcessor::FinishLockingTxns() {
+  Txn* txn;
+  while (completed_txns_.Pop(&txn)) {
+    // Commit/abort txn according to program logic's commit/abort decision.
+    if (txn->Status() == COMPLETED_C) {
+      ApplyWrites(txn);
+      txn->status_ = COMMITTED;
+    } else if (txn->Status() == COMPLETED_A) {
+      txn->status_ = ABORTED;
+    } else {
+      // Invalid TxnStatus!
+      DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+    }
+
+    // Release read locks.
+    for (KeySet::iterator it = txn->readset_.begin();
+         it != txn->readset_.end(); ++it) {
+      lm_->Release(txn, *it);
+    }
+    // Release write locks.
+    for (KeySet::iterator it = txn->writeset_.begin();
+         it != txn->writeset_.end(); ++it) {
+      lm_->Release(txn, *it);
+    }
+
+    // Return result to client.
+    txn_results_.Push(txn);
+  }
+}
+
+// Orders txns by unique id, i.e. by submission.
+static bool UniqueIdBefore(Txn* a, Txn* b) {
+  return a->unique_id_ < b->unique_id_;
+}
+
+void TxnProcessor::RunCalvinScheduler() {
+  vector<Txn*> batch;
+  Txn* txn;
+  while (running_.load()) {
+    // Sequence whatever arrived since the last batch. Concurrent clients may
+    // push txns slightly out of id order, so sort the batch.
+    while (batch.size() < CALVIN_BATCH_SIZE && txn_requests_.Pop(&txn))
+      batch.push_back(txn);
+    sort(batch.begin(), batch.end(), UniqueIdBefore);
+
+    // Request all locks of each txn in sequence order. Every request is
+    // queued, never refused; a key in both sets only takes the write lock.
+    for (uint32 i = 0; i < batch.size(); i++) {
+      txn = batch[i];
+      bool granted = true;
+      for (KeySet::iterator it = txn->readset_.begin();
+           it != txn->readset_.end(); ++it) {
+        if (!txn->writeset_.count(*it) && !lm_->ReadLock(txn, *it))
+          granted = false;
+      }
+      for (KeySet::iterator it = txn->writeset_.begin();
+           it != txn->writeset_.end(); ++it) {
+        if (!lm_->WriteLock(txn, *it))
+          granted = false;
+      }
+      // Otherwise the lock manager makes it ready once its last lock is
+      // granted.
+      if (granted)
+        ready_txns_.push_back(txn);
+    }
+    batch.clear();
+
+    FinishLockingTxns();
+
+    while (ready_txns_.size()) {
+      txn = ready_txns_.front();
+      ready_txns_.pop_front();
+      Dispatch(txn, &TxnProcessor::ExecuteTxn);
+    }
+  }
+}
+
+void TxnProcessor::RunVLLScheduler() {
+  Txn* txn;
+  while (running_.load()) {
+    // Queue the next request, unless the TxnQueue is full, in which case only
+    // finishing txns make progress.
+    if (vll_queue_.size() < VLL_QUEUE_SIZE && txn_requests_.Pop(&txn)) {
+      txn->vll_position_ = vll_queue_front_ + vll_queue_.size();
+      VLLQueueEntry entry = {txn, !VLLRequestLocks(txn)};
+      vll_queue_.push_back(entry);
+      if (entry.blocked_) {
+        vll_blocked_++;
+      } else {
+        vll_running_++;
+        Dispatch(txn, &TxnProcessor::ExecuteTxn);
+      }
+    }
+
+    // Commit/abort finished txns and release their locks.
+    bool finished = false;
     while (completed_txns_.Pop(&txn)) {
-      // Commit/abort txn according to program logic's commit/abort decision.
       if (txn->Status() == COMPLETED_C) {
         ApplyWrites(txn);
         txn->status_ = COMMITTED;
@@ -204,45 +415,184 @@ void TxnProcessor::RunLockingScheduler() {
         // Invalid TxnStatus!
         DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
       }
-      
-      // Release read locks.
-      for (set<Key>::iterator it = txn->readset_.begin();
-           it != txn->readset_.end(); ++it) {
-        lm_->Release(txn, *it);
-      }
-      // Release write locks.
-      for (set<Key>::iterator it = txn->writeset_.begin();
-           it != txn->writeset_.end(); ++it) {
-        lm_->Release(txn, *it);
-      }
+      VLLReleaseLocks(txn);
+      vll_queue_[txn->vll_position_ - vll_queue_front_].txn_ = NULL;
+      vll_running_--;
+      finished = true;
 
       // Return result to client.
       txn_results_.Push(txn);
     }
+    while (!vll_queue_.empty() && vll_queue_.front().txn_ == NULL) {
+      vll_queue_.pop_front();
+      vll_queue_front_++;
+    }
 
-    // Start executing all transactions that have newly acquired all their
-    // locks.
-    while (ready_txns_.size()) {
-      // Get next ready txn from the queue.
-      txn = ready_txns_.front();
-      ready_txns_.pop_front();
+    // A txn only becomes blocked behind txns queued before it, so only a
+    // finished txn can unblock any.
+    if (finished && vll_blocked_ > 0)
+      VLLUnblockTxns();
+  }
+}
 
-      // Start txn running in its own thread.
-      tp_.RunTask(new Method<TxnProcessor, void, Txn*>(
-            this,
-            &TxnProcessor::ExecuteTxn,
-            txn));
+bool TxnProcessor::VLLRequestLocks(Txn* txn) {
+  DenseStorage* storage = static_cast<DenseStorage*>(storage_);
+  bool free = true;
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    DenseRecord* record = storage->table_.LookupOrCreate(*it);
+    if (++record->exclusive_requests_ > 1 || record->shared_requests_ > 0)
+      free = false;
+  }
+  // A key in both sets only counts as written.
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    if (txn->writeset_.count(*it))
+      continue;
+    DenseRecord* record = storage->table_.LookupOrCreate(*it);
+    record->shared_requests_++;
+    if (record->exclusive_requests_ > 0)
+      free = false;
+  }
+  return free;
+}
+
+void TxnProcessor::VLLReleaseLocks(Txn* txn) {
+  DenseStorage* storage = static_cast<DenseStorage*>(storage_);
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    storage->table_.Lookup(*it)->exclusive_requests_--;
+  }
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    if (!txn->writeset_.count(*it))
+      storage->table_.Lookup(*it)->shared_requests_--;
+  }
+}
+
+void TxnProcessor::VLLUnblockTxns() {
+  if (++vll_round_ == 0) {
+    // The round number wrapped; forget the stale marks.
+    fill(vll_exclusive_keys_.begin(), vll_exclusive_keys_.end(), 0);
+    fill(vll_shared_keys_.begin(), vll_shared_keys_.end(), 0);
+    vll_round_ = 1;
+  }
+
+  // Hash collisions only ever keep a txn blocked, never free one wrongly.
+  int blocked = vll_blocked_;
+  for (uint32 i = 0; i < vll_queue_.size() && blocked > 0 &&
+       vll_running_ < THREAD_COUNT; i++) {
+    VLLQueueEntry* entry = &vll_queue_[i];
+    Txn* txn = entry->txn_;
+    if (txn == NULL)
+      continue;
+
+    if (entry->blocked_) {
+      blocked--;
+      bool conflict = false;
+      for (KeySet::iterator it = txn->writeset_.begin();
+           !conflict && it != txn->writeset_.end(); ++it) {
+        uint32 slot = *it % VLL_KEY_SLOTS;
+        conflict = vll_exclusive_keys_[slot] == vll_round_ ||
+                   vll_shared_keys_[slot] == vll_round_;
+      }
+      for (KeySet::iterator it = txn->readset_.begin();
+           !conflict && it != txn->readset_.end(); ++it) {
+        conflict = vll_exclusive_keys_[*it % VLL_KEY_SLOTS] == vll_round_;
+      }
+      if (!conflict) {
+        entry->blocked_ = false;
+        vll_blocked_--;
+        vll_running_++;
+        Dispatch(txn, &TxnProcessor::ExecuteTxn);
+      }
+    }
+
+    // Later txns must not overtake this one on any key it requested.
+    for (KeySet::iterator it = txn->writeset_.begin();
+         it != txn->writeset_.end(); ++it) {
+      vll_exclusive_keys_[*it % VLL_KEY_SLOTS] = vll_round_;
+    }
+    for (KeySet::iterator it = txn->readset_.begin();
+         it != txn->readset_.end(); ++it) {
+      vll_shared_keys_[*it % VLL_KEY_SLOTS] = vll_round_;
+    }
+  }
+}
+
+void TxnProcessor::RunParallelLockingScheduler() {
+  Txn* txn;
+  while (running_.load()) {
+    if (txn_requests_.Pop(&txn))
+      Dispatch(txn, &TxnProcessor::ExecuteTxnLocking);
+  }
+}
+
+void TxnProcessor::ExecuteTxnLocking(Txn* txn) {
+  // Acquire read and write locks in increasing key order, so that workers
+  // waiting on each other's locks can never deadlock. Keys that are also
+  // written only get the write lock: a read lock queued behind the txn's own
+  // write lock would never be granted.
+  KeySet::iterator read = txn->readset_.begin();
+  KeySet::iterator write = txn->writeset_.begin();
+  while (read != txn->readset_.end() || write != txn->writeset_.end()) {
+    if (write == txn->writeset_.end() ||
+        (read != txn->readset_.end() && *read < *write)) {
+      if (!txn->writeset_.count(*read))
+        concurrent_lm_->ReadLock(txn, *read);
+      ++read;
+    } else {
+      concurrent_lm_->WriteLock(txn, *write);
+      ++write;
     }
   }
+
+  ReadAndRunTxn(txn);
+
+  // Commit/abort txn according to program logic's commit/abort decision.
+  if (txn->Status() == COMPLETED_C) {
+    ApplyWrites(txn);
+    txn->status_ = COMMITTED;
+  } else if (txn->Status() == COMPLETED_A) {
+    txn->status_ = ABORTED;
+  } else {
+    // Invalid TxnStatus!
+    DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+  }
+
+  // Release read locks.
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    if (!txn->writeset_.count(*it))
+      concurrent_lm_->Release(txn, *it);
+  }
+  // Release write locks.
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    concurrent_lm_->Release(txn, *it);
+  }
+
+  // Return result to client.
+  txn_results_.Push(txn);
 }
 
 void TxnProcessor::ExecuteTxn(Txn* txn) {
+  ReadAndRunTxn(txn);
 
-  // Get the start time
-  txn->occ_start_time_ = GetTime();
+  // Hand the txn back to the RunScheduler thread.
+  completed_txns_.Push(txn);
+}
+
+void TxnProcessor::ReadAndRunTxn(Txn* txn) {
+  // OCC modes remember the version of every record they read, so that
+  // validation can tell exactly whether the record has changed since.
+  if (mode_ == OCC || mode_ == P_OCC) {
+    ReadVersionedAndRunTxn(txn);
+    return;
+  }
 
   // Read everything in from readset.
-  for (set<Key>::iterator it = txn->readset_.begin();
+  for (KeySet::iterator it = txn->readset_.begin();
        it != txn->readset_.end(); ++it) {
     // Save each read result iff record exists in storage.
     Value result;
@@ -251,7 +601,7 @@ void TxnProcessor::ExecuteTxn(Txn* txn) {
   }
 
   // Also read everything in from writeset.
-  for (set<Key>::iterator it = txn->writeset_.begin();
+  for (KeySet::iterator it = txn->writeset_.begin();
        it != txn->writeset_.end(); ++it) {
     // Save each read result iff record exists in storage.
     Value result;
@@ -261,14 +611,39 @@ void TxnProcessor::ExecuteTxn(Txn* txn) {
 
   // Execute txn's program logic.
   txn->Run();
+}
 
-  // Hand the txn back to the RunScheduler thread.
-  completed_txns_.Push(txn);
+void TxnProcessor::ReadVersionedAndRunTxn(Txn* txn) {
+  // Read everything in from readset and writeset, recording the version of
+  // each record (0 if it does not exist).
+  const KeySet* sets[2] = {&txn->readset_, &txn->writeset_};
+  for (int i = 0; i < 2; i++) {
+    for (KeySet::iterator it = sets[i]->begin(); it != sets[i]->end(); ++it) {
+      // Save each read result iff record exists in storage.
+      Value result;
+      uint64 version;
+      if (storage_->ReadVersioned(*it, &result, &version))
+        txn->reads_[*it] = result;
+      txn->read_versions_[*it] = version;
+    }
+  }
+
+  // Execute txn's program logic.
+  txn->Run();
+}
+
+bool TxnProcessor::ValidateReadVersions(Txn* txn) {
+  for (KeyVersionMap::iterator it = txn->read_versions_.begin();
+       it != txn->read_versions_.end(); ++it) {
+    if (storage_->RecordVersion(it->first) != it->second)
+      return false;
+  }
+  return true;
 }
 
 void TxnProcessor::ApplyWrites(Txn* txn) {
   // Write buffered writes out to storage.
-  for (map<Key, Value>::iterator it = txn->writes_.begin();
+  for (KeyValueMap::iterator it = txn->writes_.begin();
        it != txn->writes_.end(); ++it) {
     storage_->Write(it->first, it->second, txn->unique_id_);
   }
@@ -281,46 +656,26 @@ void TxnProcessor::RunOCCScheduler() {
   // [For now, run serial scheduler in order to make it through the test
   // suite]
   Txn* txn;
-  while(tp_.Active()) {
-    if (txn_requests_.Pop(&txn)) {
-      tp_.RunTask(new Method<TxnProcessor, void, Txn*>(
-            this,
-            &TxnProcessor::ExecuteTxn,
-            txn));
+  while (running_.load()) {
+    if (NextTxnRequest(&txn)) {
+      Dispatch(txn, &TxnProcessor::ExecuteTxn);
     }
     // handle completed txns
     while (completed_txns_.Pop(&txn)) {
-      // handle read set
-      bool validation_failed = false;
-      for (set<Key>::iterator it = txn->readset_.begin();
-         it != txn->readset_.end(); ++it) {
-           if (storage_->Timestamp(*it) > txn->occ_start_time_) {
-             validation_failed = true;
-           }
-      }
-      
-      // handle write set
-      if (!validation_failed) {
-      for (set<Key>::iterator it = txn->writeset_.begin();
-       it != txn->writeset_.end(); ++it) {
-         if (storage_->Timestamp(*it) > txn->occ_start_time_) {
-             validation_failed = true;
-           }
-      }
-	}
+      // Validate: every record read (including those in the write set) must
+      // still be at the version the txn saw.
+      bool validation_failed = !ValidateReadVersions(txn);
       
       if (validation_failed) {
         // cleanup txn
         txn->reads_.clear();
         txn->writes_.clear();
+        txn->read_versions_.clear();
         txn->status_ = INCOMPLETE;
         
         // restart txn
-        mutex_.Lock();
-        txn->unique_id_ = next_unique_id_;
-        next_unique_id_++;
-        txn_requests_.Push(txn);
-        mutex_.Unlock();
+        txn->unique_id_ = timestamps_.NextLeased();
+        RestartTxn(txn);
       } else {
         ApplyWrites(txn);
         // mark as committed
@@ -332,29 +687,8 @@ void TxnProcessor::RunOCCScheduler() {
 }
 
 void TxnProcessor::ExecuteTxnParallel(Txn *txn) {
-  // Get the start time
-  txn->occ_start_time_ = GetTime();
-
-  // Read everything in from readset.
-  for (set<Key>::iterator it = txn->readset_.begin();
-       it != txn->readset_.end(); ++it) {
-    // Save each read result iff record exists in storage.
-    Value result;
-    if (storage_->Read(*it, &result))
-      txn->reads_[*it] = result;
-  }
-
-  // Also read everything in from writeset.
-  for (set<Key>::iterator it = txn->writeset_.begin();
-       it != txn->writeset_.end(); ++it) {
-    // Save each read result iff record exists in storage.
-    Value result;
-    if (storage_->Read(*it, &result))
-      txn->reads_[*it] = result;
-  }
-
-  // Execute txn's program logic.
-  txn->Run();
+  // Read phase: read everything (remembering record versions) and run.
+  ReadVersionedAndRunTxn(txn);
   
   //critical section
   active_set_mutex_.Lock();
@@ -363,29 +697,13 @@ void TxnProcessor::ExecuteTxnParallel(Txn *txn) {
   active_set_mutex_.Unlock();
   
   //validation phase
-  bool validation_failed = false;
-  // handle read set
-  for (set<Key>::iterator it = txn->readset_.begin();
-     it != txn->readset_.end(); ++it) {
-     if (storage_->Timestamp(*it) > txn->occ_start_time_) {
-       validation_failed = true;
-     }
-  }
-  if (!validation_failed) {   
-  // handle write set
-  for (set<Key>::iterator it = txn->writeset_.begin();
-   it != txn->writeset_.end(); ++it) {
-     if (storage_->Timestamp(*it) > txn->occ_start_time_) {
-       validation_failed = true;
-     }
-  }
-  }
+  bool validation_failed = !ValidateReadVersions(txn);
   
   if (!validation_failed) {
   for (set<Txn*>::iterator it = active_set_copy.begin();
       it != active_set_copy.end(); ++it) {
 	Txn *t = *it;
-	for (set<Key>::iterator it2 = txn->writeset_.begin();
+	for (KeySet::iterator it2 = txn->writeset_.begin();
 		it2 != txn->writeset_.end(); ++it2) {
 		if (t->writeset_.count(*it2) > 0)
 			validation_failed = true;
@@ -393,7 +711,7 @@ void TxnProcessor::ExecuteTxnParallel(Txn *txn) {
 	if (validation_failed)
 		break;
 
-	for (set<Key>::iterator it3 = txn->readset_.begin();
+	for (KeySet::iterator it3 = txn->readset_.begin();
 		it3 != txn->readset_.end(); ++it3) {
 		if (t->writeset_.count(*it3) > 0)
 			validation_failed = true;
@@ -415,13 +733,11 @@ void TxnProcessor::ExecuteTxnParallel(Txn *txn) {
     // cleanup
     txn->reads_.clear();
     txn->writes_.clear();
+    txn->read_versions_.clear();
     txn->status_ = INCOMPLETE;
     // restart
-    mutex_.Lock();
-    txn->unique_id_ = next_unique_id_;
-    next_unique_id_++;
+    txn->unique_id_ = timestamps_.NextLeased();
     txn_requests_.Push(txn);
-    mutex_.Unlock();
   }
 }
 
@@ -436,77 +752,182 @@ void TxnProcessor::RunOCCParallelScheduler() {
   // [For now, run serial scheduler in order to make it through the test
   // suite]
   Txn *txn;
-  while (tp_.Active()) {
+  while (running_.load()) {
     if (txn_requests_.Pop(&txn)) {
-      tp_.RunTask(new Method<TxnProcessor, void, Txn*>(
-            this,
-            &TxnProcessor::ExecuteTxnParallel,
-            txn));
+      Dispatch(txn, &TxnProcessor::ExecuteTxnParallel);
     }
   }
 }
 
 void TxnProcessor::MVCCExecuteTxn(Txn *txn) {
-  // Read everything in from readset.
-  for (set<Key>::iterator it = txn->readset_.begin();
-       it != txn->readset_.end(); ++it) {
-    // Save each read result iff record exists in storage.
-    Value result;
-    storage_->Lock(*it);
-    if (storage_->Read(*it, &result, txn->unique_id_))
-      txn->reads_[*it] = result;
-    storage_->Unlock(*it);
+  if (txn->ReadOnly()) {
+    MVCCExecuteReadOnlyTxn(txn);
+    return;
   }
 
-  // Also read everything in from writeset.
-  for (set<Key>::iterator it = txn->writeset_.begin();
-       it != txn->writeset_.end(); ++it) {
-    // Save each read result iff record exists in storage.
-    Value result;
-    storage_->Lock(*it);
-    if (storage_->Read(*it, &result, txn->unique_id_))
-      txn->reads_[*it] = result;
-    storage_->Unlock(*it);
+  // Take the txn's timestamp now rather than at submission, so that a txn
+  // waiting in a queue holds back no garbage collection. A lower bound is
+  // announced first, so the collector never sees a watermark above it.
+  std::atomic<uint64>& slot = mvcc_slots_[MVCCWorkerSlot()].ts_;
+  slot.store(timestamps_.Peek());
+  txn->unique_id_ = timestamps_.Next();
+  slot.store(txn->unique_id_);
+
+  MVCCStorage* storage = static_cast<MVCCStorage*>(storage_);
+
+  // Read everything in from readset and writeset, without latching.
+  const KeySet* sets[2] = {&txn->readset_, &txn->writeset_};
+  for (int i = 0; i < 2; i++) {
+    for (KeySet::iterator it = sets[i]->begin(); it != sets[i]->end(); ++it) {
+      // Save each read result iff record exists in storage.
+      Value result;
+      if (storage->Read(*it, &result, txn->unique_id_))
+        txn->reads_[*it] = result;
+    }
   }
   
   txn->Run();
+
+  // A txn that aborts by its own logic writes nothing.
+  if (txn->Status() == COMPLETED_A) {
+    slot.store(0);
+    txn->status_ = ABORTED;
+    txn_results_.Push(txn);
+    return;
+  }
   
-  //Acquire all locks for keys in the write_set_
-  for (set<Key>::iterator it = txn->writeset_.begin();
+  // Latch the write set in key order, so that writers never deadlock, and link
+  // a pending version for every write.
+  for (KeySet::iterator it = txn->writeset_.begin();
       it != txn->writeset_.end(); ++it) {
-        storage_->Lock(*it);
+        storage->Lock(*it);
+  }
+  for (KeyValueMap::iterator it = txn->writes_.begin();
+      it != txn->writes_.end(); ++it) {
+        storage->WritePending(it->first, it->second, txn->unique_id_);
   }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
   
-  //Call MVCCStorage::CheckWrite method to check all keys in the write_set_
+  // Only now check each write, so that a reader that missed the pending
+  // version is seen here (see MVCCStorage::Read).
   bool all_passed = true;
-  for (set<Key>::iterator it = txn->writeset_.begin();
-      it != txn->writeset_.end(); ++it) {
-        if (!storage_->CheckWrite(*it, txn->unique_id_))
+  for (KeyValueMap::iterator it = txn->writes_.begin();
+      it != txn->writes_.end() && all_passed; ++it) {
+        if (!storage->CheckWrite(it->first, txn->unique_id_))
           all_passed = false;
   }
   
+  for (KeyValueMap::iterator it = txn->writes_.begin();
+      it != txn->writes_.end(); ++it) {
+        storage->FinishWrite(it->first, txn->unique_id_, all_passed);
+  }
+  for (KeySet::iterator it = txn->writeset_.begin();
+      it != txn->writeset_.end(); ++it) {
+        storage->Unlock(*it);
+  }
+  slot.store(0);
+  
   if (all_passed) {
-    ApplyWrites(txn);
-    for (set<Key>::iterator it = txn->writeset_.begin();
-        it != txn->writeset_.end(); ++it) {
-          storage_->Unlock(*it);
-    }
     txn->status_ = COMMITTED;
     txn_results_.Push(txn);
   } else {
-    for (set<Key>::iterator it = txn->writeset_.begin();
-        it != txn->writeset_.end(); ++it) {
-          storage_->Unlock(*it);
-    }
     txn->reads_.clear();
     txn->writes_.clear();
     txn->status_ = INCOMPLETE;
     
-    mutex_.Lock();
-    txn->unique_id_ = next_unique_id_;
-    next_unique_id_++;
+    // The restarted txn takes a fresh timestamp, newer than the versions that
+    // made it abort, when it starts running again.
     txn_requests_.Push(txn);
-    mutex_.Unlock();
+  }
+}
+
+void TxnProcessor::MVCCExecuteReadOnlyTxn(Txn* txn) {
+  MVCCStorage* storage = static_cast<MVCCStorage*>(storage_);
+  std::atomic<uint64>& slot = mvcc_slots_[MVCCWorkerSlot()].snapshot_;
+  uint64 snapshot = MVCCSnapshot(&slot);
+
+  // Read everything in from readset.
+  for (KeySet::iterator it = txn->readset_.begin();
+       it != txn->readset_.end(); ++it) {
+    // Save each read result iff record exists in storage.
+    Value result;
+    if (storage->ReadSnapshot(*it, &result, snapshot))
+      txn->reads_[*it] = result;
+  }
+
+  txn->Run();
+  slot.store(0);
+
+  if (!txn->writes_.empty())
+    DIE("Read-only txn wrote " << txn->writes_.size() << " records.");
+  txn->status_ = (txn->Status() == COMPLETED_C) ? COMMITTED : ABORTED;
+  txn_results_.Push(txn);
+}
+
+uint64 TxnProcessor::MVCCSnapshot(std::atomic<uint64>* slot) {
+  while (true) {
+    // Every txn with a smaller timestamp has finished, so nothing at or below
+    // the snapshot can change any more.
+    uint64 snapshot = MVCCWatermark(false) - 1;
+    slot->store(snapshot + 1);
+
+    // The collector publishes its bound before scanning the slots, so it
+    // either sees this snapshot or has published the bound read here.
+    if (mvcc_gc_bound_.load() <= snapshot)
+      return snapshot;
+  }
+}
+
+int TxnProcessor::MVCCWorkerSlot() {
+  static __thread TxnProcessor* owner = NULL;
+  static __thread int index = -1;
+  if (owner != this) {
+    owner = this;
+    index = mvcc_slot_count_.fetch_add(1);
+    if (index >= MVCC_GC_SLOTS)
+      DIE("More than " << MVCC_GC_SLOTS << " MVCC worker threads.");
+  }
+  return index;
+}
+
+uint64 TxnProcessor::MVCCWatermark(bool include_snapshots) {
+  // Any txn that takes its timestamp after this read gets a larger one; any
+  // txn that took it before has announced it (or a lower bound) by now.
+  uint64 watermark = timestamps_.Peek();
+  int slots = mvcc_slot_count_.load();
+  for (int i = 0; i < slots && i < MVCC_GC_SLOTS; i++) {
+    uint64 ts = mvcc_slots_[i].ts_.load();
+    if (ts != 0 && ts < watermark)
+      watermark = ts;
+    if (include_snapshots) {
+      uint64 snapshot = mvcc_slots_[i].snapshot_.load();
+      if (snapshot != 0 && snapshot < watermark)
+        watermark = snapshot;
+    }
+  }
+  return watermark;
+}
+
+void* TxnProcessor::StartGarbageCollection(void* arg) {
+  reinterpret_cast<TxnProcessor*>(arg)->GarbageCollection();
+  return NULL;
+}
+
+void TxnProcessor::GarbageCollection() {
+  MVCCStorage* storage = static_cast<MVCCStorage*>(storage_);
+  while (running_.load()) {
+    // Keep the newest version at or below the bound. Publish the bound before
+    // scanning the slots again, so that a snapshot being taken concurrently
+    // is either seen by the second scan or rejected (see MVCCSnapshot).
+    uint64 bound = MVCCWatermark(true) - 1;
+    mvcc_gc_bound_.store(bound);
+    uint64 recheck = MVCCWatermark(true) - 1;
+    if (recheck < bound)
+      bound = recheck;
+
+    // Keep going while there is a backlog; otherwise pause between rounds.
+    if (storage->CollectGarbage(bound, MVCC_GC_BATCH) < MVCC_GC_BATCH)
+      Sleep(MVCC_GC_INTERVAL);
   }
 }
 
@@ -520,67 +941,383 @@ void TxnProcessor::RunMVCCScheduler() {
   // [For now, run serial scheduler in order to make it through the test
   // suite]
   Txn *txn;
-  while (tp_.Active()) {
+  while (running_.load()) {
     if (txn_requests_.Pop(&txn)) {
-      tp_.RunTask(new Method<TxnProcessor, void, Txn*>(
-            this,
-            &TxnProcessor::MVCCExecuteTxn,
-            txn));
+      Dispatch(txn, &TxnProcessor::MVCCExecuteTxn);
     }
   }
 }
 
-bool CAS(Cluster **p, Cluster* old, Cluster *new_) {
-  if (*p != old)
-    return false;
-  *p = new_;
-  return true;
+void TxnProcessor::RunSSIScheduler() {
+  Txn* txn;
+  while (running_.load()) {
+    if (txn_requests_.Pop(&txn))
+      Dispatch(txn, &TxnProcessor::ExecuteTxnSSI);
+  }
 }
 
-void Compress(Cluster *rec, Cluster *root) {
-  while (rec->address < root->address) {
-    Cluster *child = rec, *parent = rec->parent;
-    if (parent->address < root->address) {
-      child->lock.Lock();
-      CAS(&(child->parent), parent, root);
-      child->lock.Unlock();
+void TxnProcessor::ExecuteTxnSSI(Txn* txn) {
+  MVCCStorage* storage = static_cast<MVCCStorage*>(storage_);
+  TimestampSlot& slot = mvcc_slots_[MVCCWorkerSlot()];
+  uint64 snapshot = MVCCSnapshot(&slot.snapshot_);
+
+  // Read everything in from readset and writeset at the snapshot, registering
+  // the txn as a reader of every version it reads.
+  KeyVersionMap read_versions;
+  const KeySet* sets[2] = {&txn->readset_, &txn->writeset_};
+  for (int i = 0; i < 2; i++) {
+    for (KeySet::iterator it = sets[i]->begin(); it != sets[i]->end(); ++it) {
+      if (read_versions.count(*it))
+        continue;
+      // Save each read result iff record exists in storage.
+      Value result;
+      uint64 version_id;
+      if (storage->ReadRegistered(*it, &result, snapshot, &version_id)) {
+        txn->reads_[*it] = result;
+        read_versions[*it] = version_id;
+      }
+    }
+  }
+
+  txn->Run();
+
+  // A txn that aborts by its own logic writes nothing and leaves no reads
+  // behind.
+  if (txn->Status() == COMPLETED_A) {
+    for (KeyVersionMap::iterator it = read_versions.begin();
+         it != read_versions.end(); ++it) {
+      storage->Lock(it->first);
+      storage->FinishRead(it->first, it->second, 0);
+      storage->Unlock(it->first);
     }
-    rec = rec->parent;
+    slot.snapshot_.store(0);
+    txn->status_ = ABORTED;
+    txn_results_.Push(txn);
+    return;
+  }
+
+  // Latch every key the txn accessed, in key order, so that txns sharing a key
+  // certify one at a time and each sees the other's outcome in full. Then take
+  // a commit timestamp. Announcing it keeps every new snapshot below it until
+  // the txn's versions are installed.
+  KeySet keys = txn->readset_;
+  keys.insert(txn->writeset_.begin(), txn->writeset_.end());
+  for (KeySet::iterator it = keys.begin(); it != keys.end(); ++it)
+    storage->Lock(*it);
+  slot.ts_.store(timestamps_.Peek());
+  uint64 commit_ts = timestamps_.Next();
+  slot.ts_.store(commit_ts);
+
+  // The first committer wins: abort if a key the txn writes changed since the
+  // snapshot.
+  bool commit = true;
+  for (KeyValueMap::iterator it = txn->writes_.begin();
+       it != txn->writes_.end() && commit; ++it) {
+    if (storage->NewerWrites(it->first, snapshot) != SSI_NO_NEWER)
+      commit = false;
+  }
+
+  // Outgoing rw-antidependencies: a key the txn read was overwritten by a txn
+  // that committed first. If that txn has an outgoing one of its own, it is a
+  // committed pivot, so this txn must abort instead.
+  bool out_conflict = false;
+  for (KeyVersionMap::iterator it = read_versions.begin();
+       it != read_versions.end() && commit; ++it) {
+    int newer = storage->NewerWrites(it->first, snapshot);
+    if (newer == SSI_NEWER_OUT_CONFLICT)
+      commit = false;
+    else if (newer == SSI_NEWER)
+      out_conflict = true;
+  }
+
+  // Incoming rw-antidependencies: a concurrent txn read a version this txn
+  // supersedes. A reader that registers too late to be counted here certifies
+  // after this txn and finds its versions instead.
+  bool in_conflict = false;
+  for (KeyValueMap::iterator it = txn->writes_.begin();
+       it != txn->writes_.end() && commit && !in_conflict; ++it) {
+    in_conflict = storage->HasConcurrentReaders(
+        it->first, snapshot, commit_ts, read_versions.count(it->first) > 0);
+  }
+  if (in_conflict && out_conflict)
+    commit = false;
+
+  if (commit) {
+    for (KeyValueMap::iterator it = txn->writes_.begin();
+         it != txn->writes_.end(); ++it) {
+      storage->WritePending(it->first, it->second, commit_ts);
+      storage->FinishWrite(it->first, commit_ts, true, out_conflict);
+    }
+  }
+
+  // Only committed reads count for later writers' incoming checks.
+  for (KeyVersionMap::iterator it = read_versions.begin();
+       it != read_versions.end(); ++it) {
+    storage->FinishRead(it->first, it->second, commit ? commit_ts : 0);
+  }
+  for (KeySet::iterator it = keys.begin(); it != keys.end(); ++it)
+    storage->Unlock(*it);
+  slot.ts_.store(0);
+  slot.snapshot_.store(0);
+
+  if (commit) {
+    txn->status_ = COMMITTED;
+    txn_results_.Push(txn);
+  } else {
+    txn->reads_.clear();
+    txn->writes_.clear();
+    txn->status_ = INCOMPLETE;
+    txn_requests_.Push(txn);
   }
 }
 
-Cluster* Find(Cluster *r) {
-  Cluster *root = r;
-  while (root != root->parent)
-    root = root->parent;
-  Compress(r, root);
-  return root;
+void TxnProcessor::RunSiloScheduler() {
+  Txn* txn;
+  double epoch_start = GetTime();
+  while (running_.load()) {
+    if (txn_requests_.Pop(&txn)) {
+      Dispatch(txn, &TxnProcessor::ExecuteTxnSilo);
+    }
+    if (GetTime() - epoch_start >= SILO_EPOCH_LENGTH) {
+      silo_epoch_.fetch_add(1);
+      epoch_start = GetTime();
+    }
+  }
 }
 
-Cluster* TxnProcessor::Union(Cluster *r1, Cluster *r2) {
-  while(true) {
-    Cluster *parent = Find(r1);
-    Cluster *child = Find(r2);
-    if (parent == child)
-      return parent;
-    else if (parent->address > M and child->address > M)
-      return parent;
-    
-    if (parent->address < child->address) {
-      Cluster *temp = parent;
-      parent = child;
-      child = temp;
+// TID of the last txn committed by the calling worker thread. Commit TIDs
+// chosen by one worker are strictly increasing.
+static uint64& SiloLastTid() {
+  static __thread uint64 tid = 0;
+  return tid;
+}
+
+void TxnProcessor::ExecuteTxnSilo(Txn* txn) {
+  SiloStorage* storage = static_cast<SiloStorage*>(storage_);
+
+  // Read phase: read everything from readset and writeset, remembering the
+  // TID each value was read at (0 if the record does not exist).
+  const KeySet* sets[2] = {&txn->readset_, &txn->writeset_};
+  for (int i = 0; i < 2; i++) {
+    for (KeySet::iterator it = sets[i]->begin(); it != sets[i]->end(); ++it) {
+      Value result;
+      uint64 tid;
+      if (storage->ReadStable(*it, &result, &tid))
+        txn->reads_[*it] = result;
+      txn->read_versions_[*it] = tid;
+    }
+  }
+
+  // Execute txn's program logic.
+  txn->Run();
+
+  // A txn that aborts by its own logic writes nothing, so it needs no
+  // validation.
+  if (txn->Status() == COMPLETED_A) {
+    txn->status_ = ABORTED;
+    txn_results_.Push(txn);
+    return;
+  } else if (txn->Status() != COMPLETED_C) {
+    // Invalid TxnStatus!
+    DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+  }
+
+  // Phase 1: lock the write set in key order, so that committing workers can
+  // never deadlock, then take the epoch as the serialization point.
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    storage->LockRecord(*it);
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64 epoch = silo_epoch_.load();
+
+  // Phase 2: every record read must still be at the TID it was read at, and
+  // must not be locked by another committing txn.
+  bool validation_failed = false;
+  uint64 max_tid = SiloLastTid();
+  for (KeyVersionMap::iterator it = txn->read_versions_.begin();
+       it != txn->read_versions_.end(); ++it) {
+    uint64 word = storage->RecordTid(it->first);
+    if ((word & ~SILO_LOCK_BIT) != it->second ||
+        ((word & SILO_LOCK_BIT) && txn->writeset_.count(it->first) == 0)) {
+      validation_failed = true;
+      break;
+    }
+    if (it->second > max_tid)
+      max_tid = it->second;
+  }
+
+  if (validation_failed) {
+    for (KeySet::iterator it = txn->writeset_.begin();
+         it != txn->writeset_.end(); ++it) {
+      storage->UnlockRecord(*it);
     }
-    child->lock.Lock();
-    if (CAS(&(child->parent), child, parent)) {
-      child->lock.Unlock();
-      return parent;
+    // cleanup
+    txn->reads_.clear();
+    txn->writes_.clear();
+    txn->read_versions_.clear();
+    txn->status_ = INCOMPLETE;
+    // restart
+    txn->unique_id_ = timestamps_.NextLeased();
+    txn_requests_.Push(txn);
+    return;
+  }
+
+  // Phase 3: the commit TID is larger than every TID the txn saw and than
+  // this worker's previous commit, and lies in the current epoch.
+  uint64 tid = max_tid + SILO_SEQUENCE_STEP;
+  if ((tid >> SILO_EPOCH_SHIFT) < epoch)
+    tid = (epoch << SILO_EPOCH_SHIFT) + SILO_SEQUENCE_STEP;
+  SiloLastTid() = tid;
+
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    KeyValueMap::iterator write = txn->writes_.find(*it);
+    if (write != txn->writes_.end())
+      storage->InstallAndUnlock(*it, write->second, tid);
+    else
+      storage->UnlockRecord(*it);
+  }
+
+  txn->status_ = COMMITTED;
+  txn_results_.Push(txn);
+}
+
+void TxnProcessor::RunTicTocScheduler() {
+  Txn* txn;
+  while (running_.load()) {
+    if (txn_requests_.Pop(&txn)) {
+      Dispatch(txn, &TxnProcessor::ExecuteTxnTicToc);
     }
-    child->lock.Unlock();
   }
 }
 
-void cartesian_product(set<Cluster*> *s1, set<Cluster*> *s2, set<pair<Cluster*, Cluster*> > *result) {
+// Accessors for the packed TICTOC timestamp word (see silo_storage.h).
+static inline uint64 TicTocWts(uint64 word) {
+  return word >> TICTOC_WTS_SHIFT;
+}
+
+static inline uint64 TicTocRts(uint64 word) {
+  return TicTocWts(word) + ((word >> TICTOC_DELTA_SHIFT) & TICTOC_DELTA_MAX);
+}
+
+// Packs 'wts' and 'rts' into an unlocked word. If 'rts' is too far ahead of
+// 'wts' to fit, 'wts' is moved up instead, which keeps 'rts' exact at the cost
+// of invalidating concurrent readers of the old 'wts'.
+static inline uint64 TicTocWord(uint64 wts, uint64 rts) {
+  if (rts - wts > TICTOC_DELTA_MAX)
+    wts = rts - TICTOC_DELTA_MAX;
+  return (wts << TICTOC_WTS_SHIFT) | ((rts - wts) << TICTOC_DELTA_SHIFT);
+}
+
+void TxnProcessor::ExecuteTxnTicToc(Txn* txn) {
+  SiloStorage* storage = static_cast<SiloStorage*>(storage_);
+
+  // Read phase: read everything from readset and writeset, remembering the
+  // timestamp word each value was read at.
+  const KeySet* sets[2] = {&txn->readset_, &txn->writeset_};
+  for (int i = 0; i < 2; i++) {
+    for (KeySet::iterator it = sets[i]->begin(); it != sets[i]->end(); ++it) {
+      Value result;
+      uint64 word;
+      if (storage->ReadStable(*it, &result, &word))
+        txn->reads_[*it] = result;
+      txn->read_versions_[*it] = word;
+    }
+  }
+
+  // Execute txn's program logic.
+  txn->Run();
+
+  // A txn that aborts by its own logic writes nothing, so it needs no
+  // validation.
+  if (txn->Status() == COMPLETED_A) {
+    txn->status_ = ABORTED;
+    txn_results_.Push(txn);
+    return;
+  } else if (txn->Status() != COMPLETED_C) {
+    // Invalid TxnStatus!
+    DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+  }
+
+  // Lock the write set in key order, so that committing workers can never
+  // deadlock.
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    storage->LockRecord(*it);
+  }
+
+  // The commit timestamp must be no earlier than the wts of every version
+  // read, and later than the rts of every record about to be overwritten.
+  uint64 commit_ts = 0;
+  for (KeyVersionMap::iterator it = txn->read_versions_.begin();
+       it != txn->read_versions_.end(); ++it) {
+    if (TicTocWts(it->second) > commit_ts)
+      commit_ts = TicTocWts(it->second);
+  }
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    uint64 rts = TicTocRts(storage->RecordTid(*it));
+    if (rts + 1 > commit_ts)
+      commit_ts = rts + 1;
+  }
+
+  // Every version read must still be valid at 'commit_ts'. A version whose
+  // rts is too early can be extended as long as no one has overwritten it.
+  bool validation_failed = false;
+  for (KeyVersionMap::iterator it = txn->read_versions_.begin();
+       it != txn->read_versions_.end() && !validation_failed; ++it) {
+    if (TicTocRts(it->second) >= commit_ts)
+      continue;
+    bool mine = txn->writeset_.count(it->first) > 0;
+    while (true) {
+      uint64 word = storage->RecordTid(it->first);
+      if (TicTocWts(word) != TicTocWts(it->second) ||
+          ((word & SILO_LOCK_BIT) && !mine)) {
+        validation_failed = true;
+        break;
+      }
+      // Records in the write set get a new word at install time anyway.
+      if (mine || TicTocRts(word) >= commit_ts)
+        break;
+      if (storage->CompareAndSwapTid(
+              it->first, word, TicTocWord(TicTocWts(word), commit_ts)))
+        break;
+    }
+  }
+
+  if (validation_failed) {
+    for (KeySet::iterator it = txn->writeset_.begin();
+         it != txn->writeset_.end(); ++it) {
+      storage->UnlockRecord(*it);
+    }
+    // cleanup
+    txn->reads_.clear();
+    txn->writes_.clear();
+    txn->read_versions_.clear();
+    txn->status_ = INCOMPLETE;
+    // restart
+    txn->unique_id_ = timestamps_.NextLeased();
+    txn_requests_.Push(txn);
+    return;
+  }
+
+  // Install writes as new versions valid from 'commit_ts'.
+  for (KeySet::iterator it = txn->writeset_.begin();
+       it != txn->writeset_.end(); ++it) {
+    KeyValueMap::iterator write = txn->writes_.find(*it);
+    if (write != txn->writes_.end())
+      storage->InstallAndUnlock(*it, write->second,
+                                TicTocWord(commit_ts, commit_ts));
+    else
+      storage->UnlockRecord(*it);
+  }
+
+  txn->status_ = COMMITTED;
+  txn_results_.Push(txn);
+}
+
+void cartesian_product(set<uint32> *s1, set<uint32> *s2, set<pair<uint32, uint32> > *result) {
   for (auto it = s1->begin(); it != s1->end(); ++it) {
     for (auto it2 = s2->begin(); it2 != s2->end(); ++it2) {
       result->insert(make_pair(*it, *it2));
@@ -588,101 +1325,94 @@ void cartesian_product(set<Cluster*> *s1, set<Cluster*> *s2, set<pair<Cluster*,
   }
 }
 
-void TxnProcessor::StrifePrepare(vector<Txn*> *batch, atomic_int *counter) {
+void TxnProcessor::StrifePrepare(vector<Txn*> *batch) {
+  StrifeStorage* storage = static_cast<StrifeStorage*>(storage_);
   int size=batch->size();
   for (int i=0; i<size; i++) {
     Txn *t = batch->at(i);
-    for (auto it = t->writeset_.begin(); it != t->writeset_.end(); ++it) {
-      Cluster *c = storage_->getCluster(*it);
-      c->parent = c;
-      c->count = 0;
-      c->address = reinterpret_cast<uintptr_t>(c);
-    }
-    for (auto it = t->readset_.begin(); it != t->readset_.end(); ++it) {
-      Cluster *c = storage_->getCluster(*it);
-      c->parent = c;
-      c->count = 0;
-      c->address = reinterpret_cast<uintptr_t>(c);
-    }
+    for (auto it = t->writeset_.begin(); it != t->writeset_.end(); ++it)
+      storage->Reset(storage->Slot(*it));
+    for (auto it = t->readset_.begin(); it != t->readset_.end(); ++it)
+      storage->Reset(storage->Slot(*it));
   }
-  (*counter)++;
 }
 
-void TxnProcessor::StrifeFuse(vector<Txn*> *batch, atomic_int *counter, atomic_int *count) {
+void TxnProcessor::StrifeFuse(vector<Txn*> *batch, atomic_int *count) {
+  StrifeStorage* storage = static_cast<StrifeStorage*>(storage_);
   int size = batch->size();
 
   for (int i=0; i<size; i++) {
     Txn *t = batch->at(i);
-    set<Cluster*> C,S;
+    set<uint32> C,S;
     for (auto it=t->writeset_.begin(); it != t->writeset_.end(); ++it) {
-      Cluster *root = Find(storage_->getCluster(*it));
-      if (root->address > M) {
+      uint32 root = storage->Find(storage->Slot(*it));
+      if (storage->GetCluster(root)->special_ != CLUSTER_NOT_SPECIAL) {
         S.insert(root);
       } else {
         C.insert(root);
       }
     }
     if (S.size() <= 1) {
-      Cluster *c;
+      if (S.size() == 0 && C.size() == 0)
+        continue;
+      uint32 c;
       if (S.size() == 0) {
-        if (C.size()>0) {
-          auto first = C.begin();
-          c = *first;
-          C.erase(first);
-        }
+        auto first = C.begin();
+        c = *first;
+        C.erase(first);
       } else {
         c = *(S.begin());
       }
       for (auto other = C.begin(); other != C.end(); ++other)
-        c = Union(c, *other);
-      if (c)
-        (c->count)++;
+        c = storage->Union(c, *other);
+      (storage->GetCluster(c)->count_)++;
     } else {
       // cout<<"multiple special clusters"<<endl<<flush;
-      set<pair<Cluster*, Cluster*> > SxS;
+      set<pair<uint32, uint32> > SxS;
       cartesian_product(&S, &S, &SxS);
       for (auto it=SxS.begin(); it != SxS.end(); ++it) {
-        int c1_id = it->first->id, c2_id = it->second->id;
+        int c1_id = storage->GetCluster(it->first)->special_;
+        int c2_id = storage->GetCluster(it->second)->special_;
         (*((count+c1_id*k) + c2_id))++;  // equivalent to doing count[c1_id][c2_id]++
       }
     }
   }
 
-  (*counter)++;
 }
 
-void TxnProcessor::StrifeAllocate(vector<Txn*> *batch, atomic_int *counter, unordered_map<Cluster*, AtomicQueue<Txn*> > *worklist, AtomicQueue<Txn*> *residuals) {
+void TxnProcessor::StrifeAllocate(vector<Txn*> *batch, unordered_map<uint32, AtomicQueue<Txn*> > *worklist, AtomicQueue<Txn*> *residuals) {
+  StrifeStorage* storage = static_cast<StrifeStorage*>(storage_);
   int size = batch->size();
   for (int i=0; i<size; i++) {
     Txn *t = batch->at(i);
-    set<Cluster*> C;
+    set<uint32> C;
     for (auto it=t->writeset_.begin(); it != t->writeset_.end(); ++it) {
-      C.insert(Find(storage_->getCluster(*it)));
+      C.insert(storage->Find(storage->Slot(*it)));
     }
     for (auto it=t->readset_.begin(); it != t->readset_.end(); ++it) {
-      C.insert(Find(storage_->getCluster(*it)));
+      C.insert(storage->Find(storage->Slot(*it)));
     }
     if (C.size() == 1) {
-      Cluster *c = *(C.begin());
-      if (!worklist->count(c)) {
-        mutex_.Lock();
-        (*worklist)[c].Push(t);
-        mutex_.Unlock();
-      } else 
-        (*worklist)[c].Push(t);
+      // Other chunks may insert into the worklist meanwhile, so even finding
+      // the cluster's queue needs the lock. Queues never move once inserted.
+      mutex_.Lock();
+      AtomicQueue<Txn*> *cluster = &(*worklist)[*(C.begin())];
+      mutex_.Unlock();
+      cluster->Push(t);
     } else {
       residuals->Push(t);
     }
   }
-  (*counter)++;
 }
 
-void TxnProcessor::StrifeConflictFree(queue<Txn*> *cluster, atomic_int *counter) {
+void TxnProcessor::StrifeConflictFree(queue<Txn*> *cluster) {
   // cout<<"started conflict free"<<endl;
   while (!cluster->empty()) {
     Txn *txn = cluster->front();
     cluster->pop();
-    ExecuteTxn(txn);
+    // No other thread touches the cluster's keys, so the txn commits right
+    // here rather than through 'completed_txns_'.
+    ReadAndRunTxn(txn);
     // Commit/abort txn according to program logic's commit/abort decision.
     if (txn->Status() == COMPLETED_C) {
       ApplyWrites(txn);
@@ -693,127 +1423,48 @@ void TxnProcessor::StrifeConflictFree(queue<Txn*> *cluster, atomic_int *counter)
       // Invalid TxnStatus!
       DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
     }
-    completed_txns_.Pop(&txn);
     txn_results_.Push(txn);
   }
-  (*counter)++;
 }
 
 void TxnProcessor::StrifeResidual(queue<Txn*> *residuals) {
-  Txn* txn;
-  int txns_remaining = residuals->size();
-  while (txns_remaining>0) {
-
-    if (!residuals->empty()) {
-      txn = residuals->front();
-      residuals->pop();
-    // Start processing the next transaction request.
-      bool blocked = false;
-      // Request read locks.
-      for (set<Key>::iterator it = txn->readset_.begin();
-            it != txn->readset_.end(); ++it) {
-        if (!lm_->ReadLock(txn, *it)) {
-          blocked = true;
-          // If readset_.size() + writeset_.size() > 1, and blocked, just abort
-          if (txn->readset_.size() + txn->writeset_.size() > 1) {
-            // Release all locks that already acquired
-            for (set<Key>::iterator it_reads = txn->readset_.begin(); true; ++it_reads) {
-              lm_->Release(txn, *it_reads);
-              if (it_reads == it) {
-                break;
-              }
-            }
-            break;
-          }
-        }
-      }
-          
-      if (blocked == false) {
-        // Request write locks.
-        for (set<Key>::iterator it = txn->writeset_.begin();
-              it != txn->writeset_.end(); ++it) {
-          if (!lm_->WriteLock(txn, *it)) {
-            blocked = true;
-            // If readset_.size() + writeset_.size() > 1, and blocked, just abort
-            if (txn->readset_.size() + txn->writeset_.size() > 1) {
-              // Release all read locks that already acquired
-              for (set<Key>::iterator it_reads = txn->readset_.begin(); it_reads != txn->readset_.end(); ++it_reads) {
-                lm_->Release(txn, *it_reads);
-              }
-              // Release all write locks that already acquired
-              for (set<Key>::iterator it_writes = txn->writeset_.begin(); true; ++it_writes) {
-                lm_->Release(txn, *it_writes);
-                if (it_writes == it) {
-                  break;
-                }
-              }
-              break;
-            }
-          }
-        }
-      }
-
-      // If all read and write locks were immediately acquired, this txn is
-      // ready to be executed. Else, just restart the txn
-      if (blocked == false) {
-        ready_txns_.push_back(txn);
-      } else if (blocked == true && (txn->writeset_.size() + txn->readset_.size() > 1)){
-        // mutex_.Lock();
-        txn->unique_id_ = next_unique_id_;
-        next_unique_id_++;
-        // txn_requests_.Push(txn);
-        // mutex_.Unlock();
-        residuals->push(txn);
-      }
-    }
-
-    // Process and commit all transactions that have finished running.
-    while (completed_txns_.Pop(&txn)) {
-      // Commit/abort txn according to program logic's commit/abort decision.
-      if (txn->Status() == COMPLETED_C) {
-        ApplyWrites(txn);
-        txn->status_ = COMMITTED;
-      } else if (txn->Status() == COMPLETED_A) {
-        txn->status_ = ABORTED;
-      } else {
-        // Invalid TxnStatus!
-        DIE("Completed residual Txn has invalid TxnStatus: " << txn->Status());
-      }
-      
-      // Release read locks.
-      for (set<Key>::iterator it = txn->readset_.begin();
-           it != txn->readset_.end(); ++it) {
-        lm_->Release(txn, *it);
-      }
-      // Release write locks.
-      for (set<Key>::iterator it = txn->writeset_.begin();
-           it != txn->writeset_.end(); ++it) {
-        lm_->Release(txn, *it);
-      }
-
-      // Return result to client.
-      txn_results_.Push(txn);
-      txns_remaining--;
-    }
-
-    // Start executing all transactions that have newly acquired all their
-    // locks.
-    while (ready_txns_.size()) {
-      // Get next ready txn from the queue.
-      txn = ready_txns_.front();
-      ready_txns_.pop_front();
+  vector<Txn*> txns;
+  txns.reserve(residuals->size());
+  while (!residuals->empty()) {
+    txns.push_back(residuals->front());
+    residuals->pop();
+  }
 
-      // Start txn running in its own thread.
-      tp_.RunTask(new Method<TxnProcessor, void, Txn*>(
-            this,
-            &TxnProcessor::ExecuteTxn,
-            txn));
-    }
+  atomic_int next(0);
+  TaskGroup group(tp_);
+  for (int i=0; i<THREAD_COUNT; i++) {
+    group.Add(new Method<TxnProcessor, void, vector<Txn*>*, atomic_int*>(
+        this,
+        &TxnProcessor::StrifeLockResiduals,
+        &txns, &next));
   }
+  group.Wait();
+}
+
+void TxnProcessor::StrifeLockResiduals(vector<Txn*> *txns, atomic_int *next) {
+  int size = txns->size();
+  int i;
+  while ((i = (*next)++) < size)
+    ExecuteTxnLocking(txns->at(i));
 }
 
 void TxnProcessor::StrifeExecuteBatch(vector<Txn*> *batch) {
+  StrifePlan plan;
+  StrifeAnalyzeBatch(batch, &plan);
+  StrifeRunPlan(&plan);
+}
+
+void TxnProcessor::StrifeAnalyzeBatch(vector<Txn*> *batch, StrifePlan *plan) {
   // cout<<"started batch"<<endl;
+  if (strife_tuner_ != NULL) {
+    k = strife_tuner_->K();
+    alpha = strife_tuner_->Alpha();
+  }
 
   //split batch into equal chunks for prepare, fuse, allocate steps
   vector<Txn*> chunks[THREAD_COUNT];
@@ -830,17 +1481,19 @@ void TxnProcessor::StrifeExecuteBatch(vector<Txn*> *batch) {
   }
   
   double t1 = GetTime();
-  atomic_int counter(0); // used to keep track of how many subtasks in the parallel steps have finished
+  // Runs the chunks of each parallel step, this thread included.
+  TaskGroup group(tp_);
+  StrifeStorage* storage = static_cast<StrifeStorage*>(storage_);
 
   //PREPARE
   for (int i=0; i<THREAD_COUNT; i++) {
-    tp_.RunTask(new Method<TxnProcessor, void, vector<Txn*>*, atomic_int*>(
+    group.Add(new Method<TxnProcessor, void, vector<Txn*>*>(
             this,
             &TxnProcessor::StrifePrepare,
-            &(chunks[i]), &counter));
+            &(chunks[i])));
   }
 
-  while (counter < THREAD_COUNT);
+  group.Wait();
 
 
   //SPOT
@@ -849,15 +1502,15 @@ void TxnProcessor::StrifeExecuteBatch(vector<Txn*> *batch) {
   mt19937 rng(dev());
   uniform_int_distribution<mt19937::result_type> gen(0,size-1);
 
-  int i=0, addr_counter = 1;
+  int i=0;
   int num_sampled = 0;
-  set<Cluster*> special;
+  set<uint32> special;
   for (int a=0; a<k; a++) {
     Txn *t = batch->at(gen(rng));
-    set<Cluster*> C,S;
+    set<uint32> C,S;
     for (auto it=t->writeset_.begin(); it != t->writeset_.end(); ++it) {
-      Cluster *root = Find(storage_->getCluster(*it));
-      if (root->address > M) {
+      uint32 root = storage->Find(storage->Slot(*it));
+      if (storage->GetCluster(root)->special_ != CLUSTER_NOT_SPECIAL) {
         S.insert(root);
         break;
       } else {
@@ -867,35 +1520,26 @@ void TxnProcessor::StrifeExecuteBatch(vector<Txn*> *batch) {
     if (S.size() == 0 and C.size()>0) {
       num_sampled++;
       auto first = C.begin();
-      Cluster *c = *first;
+      uint32 c = *first;
       C.erase(first);
       for (auto it=C.begin(); it!=C.end(); ++it)
-        c = Union(c, *it);
-      c->id = i++;
+        c = storage->Union(c, *it);
       // (c->count)++;
-      c->address = M + (sizeof(Cluster*)*(addr_counter++));
+      storage->GetCluster(c)->special_ = i++;
       special.insert(c);
     }
   }
-  // cout<<"spot clusters: "<<special.size()<<endl<<flush;
-  // for (auto it = special.begin(); it != special.end(); ++it) {
-  //   Cluster *c = *it;
-  //   cout<<c->value<<endl<<flush;
-  //   cout<<c->parent->value<<endl<<flush;
-  // }
-  // cout<<"-------------"<<endl<<flush;
 // double t3 = GetTime();
   //FUSE
-  counter = 0;
   atomic_int count[k][k] = {};
   for (int i=0; i<THREAD_COUNT; i++) {
-    tp_.RunTask(new Method<TxnProcessor, void, vector<Txn*>*, atomic_int*, atomic_int*>(
+    group.Add(new Method<TxnProcessor, void, vector<Txn*>*, atomic_int*>(
             this,
             &TxnProcessor::StrifeFuse,
-            &(chunks[i]), &counter, (atomic_int*)count));
+            &(chunks[i]), (atomic_int*)count));
   }
 
-  while (counter < THREAD_COUNT);
+  group.Wait();
 
   // for (int i=0; i<k; i++) {
   //   for (int j=0; j<k; j++)
@@ -905,42 +1549,28 @@ void TxnProcessor::StrifeExecuteBatch(vector<Txn*> *batch) {
 
 // double t4 = GetTime();
   //MERGE
-  set<pair<Cluster*, Cluster*> > SpecialxSpecial;
+  set<pair<uint32, uint32> > SpecialxSpecial;
   cartesian_product(&special, &special, &SpecialxSpecial);
   for (auto it=SpecialxSpecial.begin(); it != SpecialxSpecial.end(); ++it) {
-    Cluster *c1 = it->first, *c2 = it->second;
-    int n1 = count[c1->id][c2->id];
-    int n2 = c1->count + c2->count + n1;
+    Cluster *c1 = storage->GetCluster(it->first);
+    Cluster *c2 = storage->GetCluster(it->second);
+    int n1 = count[c1->special_][c2->special_];
+    int n2 = c1->count_ + c2->count_ + n1;
     // cout<<"n1: "<<n1<<" n2: "<<n2<<endl<<flush;
     if (n1 >= alpha*n2)
-      Union(c1, c2);
+      storage->MergeSpecials(it->first, it->second);
   }
 
-  // cout<<"special clusters: "<<special.size()<<endl<<flush;
-  // cout<<"The root of 10 is "<<Find(storage_->getCluster(10))->value<<endl;
-  // cout<<"The root of 20 is "<<Find(storage_->getCluster(20))->value<<endl;
-  // cout<<"The root of 30 is "<<Find(storage_->getCluster(30))->value<<endl;
-  // cout<<"The root of 40 is "<<Find(storage_->getCluster(40))->value<<endl;
-  // cout<<"The root of 50 is "<<Find(storage_->getCluster(50))->value<<endl;
-  // cout<<"The root of 60 is "<<Find(storage_->getCluster(60))->value<<endl;
-  // cout<<"The root of 70 is "<<Find(storage_->getCluster(70))->value<<endl;
-  // cout<<"The root of 80 is "<<Find(storage_->getCluster(80))->value<<endl;
-  // cout<<"The root of 90 is "<<Find(storage_->getCluster(90))->value<<endl;
 // double t5 = GetTime();
   //ALLOCATE
-  counter = 0;
-  unordered_map<Cluster*, AtomicQueue<Txn*> > worklist;
-  // unordered_map<Cluster*, deque<Txn*> > worklist;
-  AtomicQueue<Txn*> residuals;
-
   for (int i=0; i<THREAD_COUNT; i++) {
-    tp_.RunTask(new Method<TxnProcessor, void, vector<Txn*>*, atomic_int*, unordered_map<Cluster*, AtomicQueue<Txn*> > *, AtomicQueue<Txn*> *>(
+    group.Add(new Method<TxnProcessor, void, vector<Txn*>*, unordered_map<uint32, AtomicQueue<Txn*> > *, AtomicQueue<Txn*> *>(
             this,
             &TxnProcessor::StrifeAllocate,
-            &(chunks[i]), &counter, &worklist, &residuals));
+            &(chunks[i]), &plan->worklist_, &plan->residuals_));
   }
 
-  while (counter < THREAD_COUNT);
+  group.Wait();
   // cout<<"special clusters: "<<special.size()<<endl<<flush;
   // cout<<"num clusters: "<<worklist.size()<<endl<<flush;
   // cout<<"residuals "<<(double)residuals.Size()/size<<endl<<flush;
@@ -949,34 +1579,39 @@ void TxnProcessor::StrifeExecuteBatch(vector<Txn*> *batch) {
   // cout<<"preprocessing time: "<<(t6-t1)<<endl<<flush;
   // cout<<"clusters: "<<worklist.size()<<endl<<flush;
   // cout<<"txns in CF: "<<size-residuals.Size()<<endl<<flush;
-  //CONFLICT FREE
+  plan->txns_ = size;
+  plan->analyze_time_ = GetTime() - t1;
+}
 
-  // Txn *a = batch->at(50);
-  // for (auto it=a->writeset_.begin(); it != a->writeset_.end(); ++it) {
-  //   cout<<*it<<endl<<flush;
-  //   Cluster *root = storage_->getCluster(*it);
-  //   cout<<root->value<<endl<<flush;
-  // }
-  // cout<<"--------"<<endl<<flush;
-  
-  counter = 0;
-  int worklist_size = worklist.size();
+void TxnProcessor::StrifeRunPlan(StrifePlan *plan) {
+  TaskGroup group(tp_);
+  double start = GetTime();
+  StrifeBatchStats stats;
+  stats.txns_ = plan->txns_;
+  stats.residuals_ = plan->residuals_.Size();
+  stats.clusters_ = plan->worklist_.size();
+  stats.analyze_time_ = plan->analyze_time_;
+
+  //CONFLICT FREE
 
-  for (auto it=worklist.begin(); it != worklist.end(); ++it) {
-    tp_.RunTask(new Method<TxnProcessor, void, queue<Txn*>*, atomic_int*>(
+  for (auto it=plan->worklist_.begin(); it != plan->worklist_.end(); ++it) {
+    group.Add(new Method<TxnProcessor, void, queue<Txn*>*>(
         this,
         &TxnProcessor::StrifeConflictFree,
-        &(it->second.queue_), &counter));
+        &(it->second.queue_)));
   }
   
-  while (counter < worklist_size);
+  group.Wait();
   // double t7 = GetTime();
   // cout<<"CF time: "<<(t7-t6)<<endl<<flush;
 
   
   //RESIDUALS
   
-  StrifeResidual(&(residuals.queue_));
+  StrifeResidual(&(plan->residuals_.queue_));
+  stats.run_time_ = GetTime() - start;
+  if (strife_tuner_ != NULL)
+    strife_tuner_->Record(stats);
   // double t8 = GetTime();
   // cout<<"residual time: "<<(t8-t7)<<endl<<flush;
   // cout<<"total time: "<<(t8-t1)<<endl<<flush;
@@ -1006,11 +1641,11 @@ void TxnProcessor::StrifeExecuteBatch(vector<Txn*> *batch) {
 }
 
 void TxnProcessor::HandleBatches() {
-  vector<Txn*> *batch;
-  while(tp_.Active()) {
-    if (batch_list.Pop(&batch)) {
-      StrifeExecuteBatch(batch);
-      delete batch;
+  StrifePlan *plan;
+  while (running_.load()) {
+    if (strife_plans_.Pop(&plan)) {
+      StrifeRunPlan(plan);
+      delete plan;
     }
   }
 }
@@ -1020,70 +1655,32 @@ void* TxnProcessor::StartStrife(void * arg) {
   return NULL;
 }
 
-void* TxnProcessor::StartBatch(void *arg) {
-  StrifeHandler *h = reinterpret_cast<StrifeHandler*>(arg);
-  TxnProcessor *p = h->p;
-  vector<Txn*> *batch = h->batch;
-  p->StrifeExecuteBatch(batch);
-  return NULL;
-}
-
 void TxnProcessor::RunStrifeScheduler() {
-
-  // vector<Txn*> *batch = new vector<Txn*>();
-  // double duration = 0.01, startTime = GetTime();
-  // Txn *txn;
-  // while (tp_.Active()) {
-  //   if (txn_requests_.Pop(&txn))
-  //     batch->push_back(txn);
-  //   if (batch->size() > 0 and GetTime()-startTime >= duration) {
-  //     batch_list.Push(batch);
-  //     batch = new vector<Txn*>();
-  //     startTime = GetTime();
-  //   }
-  //   if (prev_batch_finished and batch_list.Size()>0) {
-  //     vector<Txn*> *next_batch;
-  //     batch_list.Pop(&next_batch);
-  //     prev_batch_finished = false;
-  //     pthread_t start_batch;
-  //     StrifeHandler h;
-  //     h.batch = next_batch;
-  //     h.p = this;
-  //     pthread_create(&start_batch, NULL, StartBatch, reinterpret_cast<void*>(&h));
-  //   }
-  // }
-
-  // vector<Txn*> *batch = new vector<Txn*>();
-  // double duration=0.0001, startTime = GetTime();
-  // Txn *txn;
-  // while (tp_.Active()) {
-  //   if (txn_requests_.Pop(&txn))
-  //     batch->push_back(txn);
-  //   if (batch->size() > 0 and GetTime() - startTime >= duration) {
-  //     batch_list.Push(batch);
-  //     startTime = GetTime();
-  //     batch = new vector<Txn*>();
-  //   }
-  // }
-
-
-
   vector<Txn*> batch;
   double duration = 0.001;
   double startTime = GetTime();
   Txn *txn;
-  while (tp_.Active()) {
+  while (running_.load()) {
     if (txn_requests_.Pop(&txn)) {
       batch.push_back(txn);
     } 
-    // else
-    //   StrifeExecuteBatch2(&batch);
     if (GetTime() - startTime >= duration && batch.size()>0) {
-      StrifeExecuteBatch(&batch);
+      if (mode_ == STRIFE) {
+        StrifeExecuteBatch(&batch);
+      } else if (strife_plans_.Size() == 0) {
+        // The executor is busy with at most the previous batch. Otherwise
+        // keep growing this batch rather than queueing plans that would
+        // wait anyway.
+        StrifePlan *plan = new StrifePlan();
+        StrifeAnalyzeBatch(&batch, plan);
+        strife_plans_.Push(plan);
+      } else {
+        continue;
+      }
       batch.clear();
       startTime = GetTime();
+      if (strife_tuner_ != NULL)
+        duration = strife_tuner_->Duration();
     }
   }
-  
 }
-
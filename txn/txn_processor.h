@@ -9,15 +9,23 @@
 #include "txn/common.h"
 #include "txn/lock_manager.h"
 #include "txn/storage.h"
+#include "txn/dense_storage.h"
 #include "txn/mvcc_storage.h"
 #include "txn/strife_storage.h"
+#include "txn/strife_tuner.h"
+#include "txn/silo_storage.h"
+#include "txn/timestamp_oracle.h"
 #include "txn/txn.h"
 #include "utils/atomic.h"
+#include "utils/lock_free_queue.h"
 #include "utils/static_thread_pool.h"
+#include "utils/task_group.h"
+#include "utils/work_stealing_thread_pool.h"
 #include "utils/mutex.h"
 #include "utils/condition.h"
 
 
+using std::atomic_int;
 using std::deque;
 using std::map;
 using std::string;
@@ -32,28 +40,109 @@ enum CCMode {
         P_OCC = 4,                  // Part 3
         MVCC = 5,                   // Part 4
         STRIFE = 6,
+        P_LOCKING = 7,              // Locking B, with locks taken by workers
+        SILO = 8,                   // Decentralized OCC with per-record TIDs
+        TICTOC = 9,                 // OCC with lazily computed commit timestamps
+        SSI = 10,                   // Serializable snapshot isolation on MVCC
+        CALVIN = 11,                // Deterministic locking in sequence order
+        VLL = 12,                   // Very lightweight locking, per-record counters
+        STRIFE_PIPELINED = 13,      // Strife, analyzing a batch while the last runs
 };
 
 // Returns a human-readable string naming of the providing mode.
 string ModeToString(CCMode mode);
 
+// Storage engines that the single-version modes (SERIAL, LOCKING_EXCLUSIVE_ONLY,
+// LOCKING, OCC and P_OCC) can run on. MVCC, STRIFE(_PIPELINED), SILO, TICTOC
+// and SSI always use their own storage, and VLL always uses DenseStorage.
+enum StorageMode {
+        HASH_STORAGE = 0,           // Storage (tr1::unordered_map per field)
+        DENSE_STORAGE = 1,          // DenseStorage (array of record slots)
+};
+
+// Number of slots in the rings carrying txns between the client, the
+// scheduler and the workers. Only 'txn_requests_' is bounded by it (the
+// client's NewTxnRequest waits while it is full); results spill over instead.
+#define TXN_QUEUE_CAPACITY (1 << 16)
+
+// Number of slots in 'strife_plans_'. The scheduler only queues a plan once
+// the previous one has been taken, so a handful is plenty.
+#define STRIFE_PLAN_QUEUE_CAPACITY 4
+
+// Maximum number of worker threads that can run MVCC txns, i.e. the number of
+// timestamp slots the MVCC garbage collector scans.
+#define MVCC_GC_SLOTS 64
+
+// A worker's announced MVCC timestamp and read-only snapshot, alone on their
+// cache line. Each is 0 while the worker runs no such txn; 'snapshot_' holds
+// one more than the snapshot, so that snapshot 0 can be announced too.
+struct TimestampSlot {
+  std::atomic<uint64> ts_;
+  std::atomic<uint64> snapshot_;
+  char pad_[48];
+};
+
+// A txn in the VLL scheduler's TxnQueue. 'txn_' is NULL once the txn has
+// finished; 'blocked_' is true until the txn is dispatched.
+struct VLLQueueEntry {
+  Txn* txn_;
+  bool blocked_;
+};
+
+// A Strife batch after analysis: the txns of each conflict-free cluster, and
+// the residual txns that span clusters, plus what the StrifeTuner needs to
+// know about the analysis.
+struct StrifePlan {
+  unordered_map<uint32, AtomicQueue<Txn*> > worklist_;  // By root slot
+  AtomicQueue<Txn*> residuals_;
+  int txns_;
+  double analyze_time_;
+};
+
+// Thread pools that the TxnProcessor can run its workers on.
+enum ThreadPoolMode {
+        STATIC_POOL = 0,            // StaticThreadPool (random queue, polling)
+        WORK_STEALING_POOL = 1,     // WorkStealingThreadPool (stealing, parking)
+};
+
 class TxnProcessor {
 public:
 // The TxnProcessor's constructor starts the TxnProcessor running in the
-// background.
-explicit TxnProcessor(CCMode mode, int k_ = 0, double alpha_ = 0.0);
+// background. In the Strife modes, 'k_' and 'alpha_' are the number of spot
+// samples and the merge threshold; a 'k_' of 0 or less makes a StrifeTuner
+// pick both, and the batch window, online.
+explicit TxnProcessor(CCMode mode, int k_ = 0, double alpha_ = 0.0,
+                      StorageMode storage_mode = HASH_STORAGE,
+                      ThreadPoolMode pool_mode = STATIC_POOL);
 
 // The TxnProcessor's destructor stops all background threads and deallocates
 // all objects currently owned by the TxnProcessor, except for Txn objects.
 ~TxnProcessor();
 
 // Registers a new txn request to be executed by the TxnProcessor.
-// Ownership of '*txn' is transfered to the TxnProcessor.
+// Ownership of '*txn' is transfered to the TxnProcessor. Waits while
+// TXN_QUEUE_CAPACITY requests are already queued, until the scheduler has
+// taken some of them.
 void NewTxnRequest(Txn* txn);
 
+// Registers all txns in 'txns' at once, assigning them consecutive unique ids
+// in vector order. Ownership of the txns is transfered to the TxnProcessor.
+void NewTxnRequests(const vector<Txn*>& txns);
+
 // Returns a pointer to the next COMMITTED or ABORTED Txn. The caller takes
-// ownership of the returned Txn.
-Txn* GetTxnResult();
+// ownership of the returned Txn. Sleeps until a result is available, or
+// returns NULL if none arrives within 'timeout' seconds (a negative 'timeout'
+// waits forever).
+Txn* GetTxnResult(double timeout = -1);
+
+// Waits (as GetTxnResult) for at least one result, then appends it and up to
+// 'max' - 1 further results that are already available to '*results'. Returns
+// the number of results appended; the caller takes ownership of them.
+int GetTxnResults(vector<Txn*>* results, int max, double timeout = -1);
+
+// Returns the MVCC garbage collector's counters so far. Dies unless in MVCC
+// or SSI mode.
+MVCCGCStats GarbageCollectionStats();
 
 // Main loop implementing all concurrency control/thread scheduling.
 void RunScheduler();
@@ -74,6 +163,57 @@ void RunSerialScheduler();
 // Locking version of scheduler.
 void RunLockingScheduler();
 
+// Puts 'txn' back behind the queued requests, for schedulers that restart txns
+// on their own thread. That thread is the only consumer of 'txn_requests_', so
+// it must not wait for a free slot there: if the ring is full, the txn goes to
+// 'restarted_txns_' instead.
+void RestartTxn(Txn* txn);
+
+// Pops the next txn for a scheduler that uses RestartTxn: txns that did not
+// fit into 'txn_requests_' come first, since they have waited longest.
+bool NextTxnRequest(Txn** txn);
+
+// Locking version of scheduler in which each worker acquires and releases its
+// own txn's locks through 'concurrent_lm_'.
+void RunParallelLockingScheduler();
+
+// Acquires all of 'txn''s locks, executes it, commits or aborts it, and
+// releases its locks.
+void ExecuteTxnLocking(Txn* txn);
+
+// Deterministic (Calvin-style) version of scheduler. Sequences incoming txns
+// in batches ordered by unique id and requests every lock of each txn in that
+// order, queueing behind earlier txns instead of restarting. A txn only ever
+// waits for txns sequenced before it, so there are no deadlocks, and it runs
+// as soon as it holds all its locks.
+void RunCalvinScheduler();
+
+// Commits or aborts every txn in 'completed_txns_', releases its locks through
+// 'lm_' and returns its result (used by LOCKING and CALVIN).
+void FinishLockingTxns();
+
+// VLL version of scheduler. Instead of a lock table, every record counts the
+// queued txns that requested it exclusively and shared (see DenseRecord). A
+// txn bumps the counters of all its keys on arrival and is appended to a FIFO
+// TxnQueue; it is free, and runs at once, iff it is the only requester of each
+// key it writes and no txn requested to write a key it reads. A blocked txn
+// runs once every txn queued before it has finished, or earlier if
+// VLLUnblockTxns finds that it conflicts with none of them.
+void RunVLLScheduler();
+
+// Bumps the VLL request counters of every key of 'txn'. Returns true iff the
+// txn is free.
+bool VLLRequestLocks(Txn* txn);
+
+// Undoes VLLRequestLocks(txn).
+void VLLReleaseLocks(Txn* txn);
+
+// Selective contention analysis: walks 'vll_queue_' from the front, tracking
+// the keys requested by the txns passed in two hashed bitmaps, and dispatches
+// every blocked txn none of whose keys conflicts with them, while fewer than
+// THREAD_COUNT txns run.
+void VLLUnblockTxns();
+
 // OCC version of scheduler.
 void RunOCCScheduler();
 
@@ -83,10 +223,46 @@ void RunOCCParallelScheduler();
 // MVCC version of scheduler.
 void RunMVCCScheduler();
 
+// SILO version of scheduler. Only dispatches txns and advances the epoch;
+// workers validate and commit their own txns.
+void RunSiloScheduler();
+
+// Reads and runs 'txn', then commits it Silo-style: locks its write set in key
+// order, validates the TIDs of every record it read, and installs its writes
+// under a fresh commit TID. Restarts the txn if validation fails.
+void ExecuteTxnSilo(Txn* txn);
+
+// TICTOC version of scheduler. Only dispatches txns; workers validate and
+// commit their own txns.
+void RunTicTocScheduler();
+
+// Reads and runs 'txn', then commits it TicToc-style: locks its write set in
+// key order, computes the earliest commit timestamp consistent with the
+// wts/rts of every record it accessed, extends the rts of the records it only
+// read up to that timestamp, and installs its writes at that timestamp.
+// Restarts the txn if some record it read was overwritten at or before it.
+void ExecuteTxnTicToc(Txn* txn);
+
+// Runs 'method' on 'txn' in the thread pool, without allocating a task.
+//
+// Requires: 'txn' is not already queued in the pool.
+void Dispatch(Txn* txn, void (TxnProcessor::*method)(Txn*));
+
 // Performs all reads required to execute the transaction, then executes the
 // transaction logic.
 void ExecuteTxn(Txn* txn);
 
+// Same as 'ExecuteTxn', without handing the txn back to the scheduler.
+void ReadAndRunTxn(Txn* txn);
+
+// Same as 'ReadAndRunTxn', also recording in txn->read_versions_ the version
+// of every record read (used for OCC).
+void ReadVersionedAndRunTxn(Txn* txn);
+
+// Returns true iff every record in txn->read_versions_ is still at the version
+// the txn read.
+bool ValidateReadVersions(Txn* txn);
+
 // Applies all writes performed by '*txn' to 'storage_'.
 //
 // Requires: txn->Status() is COMPLETED_C.
@@ -101,56 +277,129 @@ void MVCCLockWriteKeys(Txn* txn);
 
 void MVCCUnlockWriteKeys(Txn* txn);
 
+// Background loop run by 'gc_thread_' in MVCC mode: repeatedly trims version
+// chains down to what running txns and snapshots can still read.
 void GarbageCollection();
 
-// Strife version of scheduler
+static void* StartGarbageCollection(void* arg);
+
+// Returns a timestamp no larger than that of any MVCC txn that is running or
+// will run, and if 'include_snapshots' is true, larger than no announced
+// read-only snapshot either.
+uint64 MVCCWatermark(bool include_snapshots);
+
+// Announces in '*slot' and returns a snapshot timestamp below every MVCC
+// txn that is running or will run, which the garbage collector has not yet
+// trimmed past.
+uint64 MVCCSnapshot(std::atomic<uint64>* slot);
+
+// Runs a read-only MVCC txn at a stable snapshot. It never marks the versions
+// it reads and never restarts.
+void MVCCExecuteReadOnlyTxn(Txn* txn);
+
+// Returns the index in 'mvcc_slots_' owned by the calling worker thread,
+// claiming one on first use.
+int MVCCWorkerSlot();
+
+// SSI version of scheduler. Only dispatches txns; workers certify and commit
+// their own txns.
+void RunSSIScheduler();
+
+// Runs 'txn' at a stable snapshot and commits it with serializable snapshot
+// isolation: aborts it if a txn that committed after the snapshot wrote a key
+// it writes, or if it would become the pivot of a dangerous structure, i.e.
+// have both an incoming rw-antidependency from a concurrent txn and an
+// outgoing one to a concurrent txn that committed first. Restarts aborted
+// txns.
+void ExecuteTxnSSI(Txn* txn);
+
+// Strife version of scheduler. Collects txns into batches of at least
+// 'duration' seconds each. In STRIFE mode it analyzes and runs each batch
+// itself; in STRIFE_PIPELINED mode it only analyzes them and queues the plans
+// for 'strife_executor_', collecting the next batch while a plan waits.
 void RunStrifeScheduler();
 
-Cluster* Union(Cluster *r1, Cluster *r2);
-
+// Analyzes and then runs 'batch' (used by STRIFE).
 void StrifeExecuteBatch(vector<Txn*> *);
-void StrifeExecuteBatch2(vector<Txn*> *);
 
-void StrifePrepare(vector<Txn*> *, atomic_int *);
+// Partitions 'batch' into conflict-free clusters and residuals (the prepare,
+// spot, fuse, merge and allocate steps), filling in '*plan'. Only touches the
+// clusters' partitioning state, never their values, so it may run while the
+// previous batch's plan executes.
+void StrifeAnalyzeBatch(vector<Txn*> *batch, StrifePlan *plan);
 
-void StrifeFuse(vector<Txn*> *batch, atomic_int *counter, atomic_int *);
+// Runs every cluster of '*plan' in parallel, then its residuals, and returns
+// once all its txns have committed or aborted.
+void StrifeRunPlan(StrifePlan *plan);
 
-void StrifeAllocate(vector<Txn*> *batch, atomic_int *counter, unordered_map<Cluster*, AtomicQueue<Txn*> > *worklist, AtomicQueue<Txn*> *residuals);
+// Steps of StrifeAnalyzeBatch and StrifeRunPlan, each run for one chunk of
+// the batch (or one cluster) in a TaskGroup.
+void StrifePrepare(vector<Txn*> *);
 
-void StrifeConflictFree(queue<Txn*> *cluster, atomic_int *counter);
+void StrifeFuse(vector<Txn*> *batch, atomic_int *);
 
-void StrifeConflictFree2(AtomicQueue<Txn*> *cluster, atomic_int *counter);
+void StrifeAllocate(vector<Txn*> *batch, unordered_map<uint32, AtomicQueue<Txn*> > *worklist, AtomicQueue<Txn*> *residuals);
 
-void StrifeConflictFree3(AtomicQueue<AtomicQueue<Txn*> *> *worklist, atomic_int *counter);
+void StrifeConflictFree(queue<Txn*> *cluster);
 
+// Runs the residual txns of a batch on the worker pool (and the calling
+// thread), each taking its locks through 'concurrent_lm_' in key order as in
+// P_LOCKING mode, so that they neither deadlock nor restart.
 void StrifeResidual(queue<Txn*> *residuals);
 
-static void* StartStrife(void*);
+// Runs ExecuteTxnLocking on the txns of '*txns' from index '*next' on,
+// claiming one index at a time, until none is left.
+void StrifeLockResiduals(vector<Txn*> *txns, atomic_int *next);
+
+// Background loop run by 'strife_executor_' in STRIFE_PIPELINED mode: runs
+// the plans in 'strife_plans_' one at a time, in the order they were analyzed,
+// so a batch only starts once the previous one has finished.
 void HandleBatches();
-static void* StartBatch(void *arg);
+
+static void* StartStrife(void*);
 
 // Concurrency control mechanism the TxnProcessor is currently using.
 CCMode mode_;
 
 // Thread pool managing all threads used by TxnProcessor.
-StaticThreadPool tp_;
+ThreadPool* tp_;
+
+// Thread running 'RunScheduler()'.
+pthread_t scheduler_;
+
+// Cleared by the destructor to make the scheduler, Strife executor and MVCC
+// garbage collection loops exit, before the thread pool is stopped.
+std::atomic<bool> running_;
 
 // Data storage used for all modes.
 Storage* storage_;
 
-// Next valid unique_id, and a mutex to guard incoming txn requests.
-int next_unique_id_;
+// Source of txn unique ids (logical timestamps).
+TimestampOracle timestamps_;
+
+// Guards Strife's shared worklist.
 Mutex mutex_;
 
-// Strife specific variables
+// Strife specific variables. 'strife_tuner_' is NULL unless the Strife
+// parameters are tuned online.
+StrifeTuner* strife_tuner_;
 int k;
 double alpha, processing_time=0.0;
-uintptr_t M;
-AtomicQueue<vector<Txn*>* > batch_list;
-bool prev_batch_finished = true;
 
-// Queue of incoming transaction requests.
-AtomicQueue<Txn*> txn_requests_;
+// Analyzed batches waiting for 'strife_executor_' in STRIFE_PIPELINED mode,
+// and the thread running 'HandleBatches()'.
+SPSCQueue<StrifePlan*> strife_plans_;
+pthread_t strife_executor_;
+
+// Queue of incoming transaction requests. Pushed by the client and by workers
+// restarting txns, so it needs to be multi-producer. Workers may wait for a
+// free slot, since the scheduler keeps draining it; the scheduler itself
+// restarts txns through RestartTxn.
+LockFreeQueue<Txn*> txn_requests_;
+
+// Txns restarted by the scheduler while 'txn_requests_' was full. Only ever
+// accessed by the scheduler thread.
+deque<Txn*> restarted_txns_;
 
 // Queue of txns that have acquired all locks and are ready to be executed.
 //
@@ -159,11 +408,12 @@ AtomicQueue<Txn*> txn_requests_;
 deque<Txn*> ready_txns_;
 
 // Queue of completed (but not yet committed/aborted) transactions.
-AtomicQueue<Txn*> completed_txns_;
+LockFreeQueue<Txn*> completed_txns_;
 
 // Queue of transaction results (already committed or aborted) to be returned
-// to client.
-AtomicQueue<Txn*> txn_results_;
+// to client. Unbounded, so that workers never wait for the client to collect
+// results: a client may submit any number of txns before reading any.
+BlockingQueue<Txn*> txn_results_;
 
 // Set of transactions that are currently in the process of parallel
 // validation.
@@ -174,6 +424,43 @@ Mutex active_set_mutex_;
 
 // Lock Manager used for LOCKING concurrency implementations.
 LockManager* lm_;
+
+// VLL's TxnQueue, holding every txn from its arrival until it and all txns
+// queued before it have finished, and the position (see Txn::vll_position_)
+// of its front entry.
+deque<VLLQueueEntry> vll_queue_;
+uint64 vll_queue_front_;
+
+// Numbers of dispatched txns that have not finished yet, and of blocked txns,
+// in 'vll_queue_'.
+int vll_running_;
+int vll_blocked_;
+
+// Hashed key bitmaps used by VLLUnblockTxns. A slot is set iff it holds the
+// number of the current round, so they never need clearing.
+vector<uint32> vll_exclusive_keys_;
+vector<uint32> vll_shared_keys_;
+uint32 vll_round_;
+
+// Lock Manager used by the workers in P_LOCKING mode, and for the residual
+// txns in the Strife modes.
+ConcurrentLockManager* concurrent_lm_;
+
+// Timestamps announced by the workers running MVCC txns, and the number of
+// slots claimed so far.
+TimestampSlot mvcc_slots_[MVCC_GC_SLOTS];
+std::atomic<int> mvcc_slot_count_;
+
+// Bound up to which the MVCC garbage collector is trimming. Snapshots below it
+// are not taken.
+std::atomic<uint64> mvcc_gc_bound_;
+
+// Thread running 'GarbageCollection()' in MVCC mode.
+pthread_t gc_thread_;
+
+// Current SILO epoch, advanced by the scheduler every SILO_EPOCH_LENGTH
+// seconds. Forms the high bits of every commit TID.
+std::atomic<uint64> silo_epoch_;
 };
 
 #endif  // _TXN_PROCESSOR_H_
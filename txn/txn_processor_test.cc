@@ -1,13 +1,58 @@
 
 #include "txn/txn_processor.h"
 
+#include <algorithm>
 #include <vector>
 
 #include "txn/txn_types.h"
+#include "utils/atomic.h"
+#include "utils/lock_free_queue.h"
+#include "utils/static_thread_pool.h"
 #include "utils/testing.h"
+#include "utils/work_stealing_thread_pool.h"
 
 using namespace std;
 
+// Calls to the global operator new, counted for the allocation benchmark
+// only. Other benchmarks leave counting off and pay a single branch per
+// allocation. Each thread counts in its own cache line, so the count never
+// becomes a shared hot spot.
+#define ALLOC_COUNTER_SLOTS 256
+
+struct AllocCounter {
+  atomic_long count_;
+  char pad_[64 - sizeof(atomic_long)];
+};
+
+AllocCounter alloc_counters[ALLOC_COUNTER_SLOTS];
+atomic_int alloc_counter_threads(0);
+bool count_allocations = false;
+
+void* operator new(size_t size) {
+  if (count_allocations) {
+    static __thread int slot = -1;
+    if (slot < 0)
+      slot = alloc_counter_threads++ % ALLOC_COUNTER_SLOTS;
+    alloc_counters[slot].count_.fetch_add(1, memory_order_relaxed);
+  }
+  void* p = malloc(size);
+  if (p == NULL)
+    throw bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+// Returns the number of allocations counted so far.
+long Allocations() {
+  long total = 0;
+  for (int i = 0; i < ALLOC_COUNTER_SLOTS; i++)
+    total += alloc_counters[i].count_.load(memory_order_relaxed);
+  return total;
+}
+
 // Returns a human-readable string naming of the providing mode.
 string ModeToString(CCMode mode) {
   switch (mode) {
@@ -18,6 +63,13 @@ string ModeToString(CCMode mode) {
     case P_OCC:                  return " OCC-P    ";
     case MVCC:                   return " MVCC     ";
     case STRIFE:                 return " Strife   ";
+    case STRIFE_PIPELINED:       return " Strife-P ";
+    case P_LOCKING:              return " Locking-P";
+    case SILO:                   return " Silo     ";
+    case TICTOC:                 return " TicToc   ";
+    case SSI:                    return " SSI      ";
+    case CALVIN:                 return " Calvin   ";
+    case VLL:                    return " VLL      ";
     default:                     return "INVALID MODE";
   }
 }
@@ -136,9 +188,9 @@ void Benchmark(const vector<LoadGen*>& lg, int num_txns) {
   deque<Txn*> doneTxns;
 
   // For each MODE...
-  for (CCMode mode = STRIFE;
-      mode <= STRIFE;
-      mode = static_cast<CCMode>(mode+1)) {
+  CCMode modes[] = {STRIFE, STRIFE_PIPELINED};
+  for (int m = 0; m < 2; m++) {
+    CCMode mode = modes[m];
     // Print out mode name.
     // cout << ModeToString(mode) << flush;
 
@@ -151,7 +203,7 @@ void Benchmark(const vector<LoadGen*>& lg, int num_txns) {
 
         // Create TxnProcessor in next mode.
         TxnProcessor* p;
-        if (mode == STRIFE)
+        if (mode == STRIFE || mode == STRIFE_PIPELINED)
           p = new TxnProcessor(mode, 50, 0.2);
         else
           p = new TxnProcessor(mode);
@@ -220,9 +272,9 @@ void Benchmark2(const vector<LoadGen*>& lg, int num_txns) {
   deque<Txn*> doneTxns;
 
   // For each MODE...
-  for (CCMode mode = LOCKING;
-      mode <= P_OCC;
-      mode = static_cast<CCMode>(mode+1)) {
+  CCMode modes[] = {LOCKING, CALVIN, VLL, OCC, P_OCC, SILO, TICTOC};
+  for (int m = 0; m < 7; m++) {
+    CCMode mode = modes[m];
     // Print out mode name.
     cout << ModeToString(mode) << endl<< flush;
 
@@ -232,7 +284,7 @@ void Benchmark2(const vector<LoadGen*>& lg, int num_txns) {
 
         // Create TxnProcessor in next mode.
         TxnProcessor* p;
-        if (mode == STRIFE)
+        if (mode == STRIFE || mode == STRIFE_PIPELINED)
           p = new TxnProcessor(mode, 50, 0.5);
         else
           p = new TxnProcessor(mode);
@@ -281,11 +333,12 @@ void TestStrife(const vector<LoadGen*>& lg, int num_txns) {
   double max_throughput = 0, best_alpha=0.0;
   int best_k=0;
   for (uint32 exp = 0; exp < lg.size(); exp++) {
-    for (int k=5; k<=50; k+=5) {
+    // k = 0 lets the processor tune k, alpha and the batch window itself.
+    for (int k=0; k<=50; k+=5) {
       // for (double alpha = 0.1; alpha <= 0.91; alpha+=0.1) {
         deque<Txn*> doneTxns;
         int txn_count=0;
-        TxnProcessor *p = new TxnProcessor(STRIFE, 5, 0.2);
+        TxnProcessor *p = new TxnProcessor(STRIFE, k, 0.2);
         // int num_txns = 1000;
         double start = GetTime();
         for (int i = 0; i < num_txns; i++)
@@ -305,7 +358,10 @@ void TestStrife(const vector<LoadGen*>& lg, int num_txns) {
         }
         double end = GetTime();
         double throughput = txn_count/(end-start);
-        cout<<"k: "<<k<<", throughput: "<<throughput<<endl<<flush;
+        if (k == 0)
+          cout<<"k: auto, throughput: "<<throughput<<endl<<flush;
+        else
+          cout<<"k: "<<k<<", throughput: "<<throughput<<endl<<flush;
         if (throughput > max_throughput) {
           max_throughput = throughput;
           // best_k = k;
@@ -318,11 +374,328 @@ void TestStrife(const vector<LoadGen*>& lg, int num_txns) {
   // cout<<"best alpha: "<<best_alpha<<", best throughput: "<<max_throughput<<endl<<flush;
 }
 
+// Shared state for one queue microbenchmark run.
+template<typename Q>
+struct QueueBench {
+  Q* queue;
+  int items_per_producer;
+  atomic_int consumed;
+  int total;
+};
+
+template<typename Q>
+void* QueueBenchProducer(void* arg) {
+  QueueBench<Q>* b = reinterpret_cast<QueueBench<Q>*>(arg);
+  for (int i = 1; i <= b->items_per_producer; i++)
+    b->queue->Push(reinterpret_cast<Txn*>(i));
+  return NULL;
+}
+
+template<typename Q>
+void* QueueBenchConsumer(void* arg) {
+  QueueBench<Q>* b = reinterpret_cast<QueueBench<Q>*>(arg);
+  Txn* txn;
+  while (b->consumed < b->total) {
+    if (b->queue->Pop(&txn))
+      b->consumed++;
+  }
+  return NULL;
+}
+
+// Pushes 'items' pointers through a queue of type Q from 'producers' threads
+// to 'consumers' threads and returns the throughput in items per second.
+template<typename Q>
+double RunQueueBench(int producers, int consumers, int items) {
+  Q queue;
+  QueueBench<Q> b;
+  b.queue = &queue;
+  b.items_per_producer = items / producers;
+  b.consumed = 0;
+  b.total = b.items_per_producer * producers;
+
+  vector<pthread_t> threads(producers + consumers);
+  double start = GetTime();
+  for (int i = 0; i < consumers; i++)
+    pthread_create(&threads[i], NULL, QueueBenchConsumer<Q>, &b);
+  for (int i = 0; i < producers; i++)
+    pthread_create(&threads[consumers + i], NULL, QueueBenchProducer<Q>, &b);
+  for (uint32 i = 0; i < threads.size(); i++)
+    pthread_join(threads[i], NULL);
+  return b.total / (GetTime() - start);
+}
+
+// Compares the mutex-based AtomicQueue with the lock-free ring queues used
+// for the TxnProcessor pipeline.
+void BenchmarkQueues() {
+  int items = 2000000;
+  cout << "producers/consumers\tAtomicQueue\tLockFreeQueue\tSPSCQueue" << endl;
+  int shapes[][2] = {{1, 1}, {1, 4}, {4, 1}, {4, 4}, {8, 1}};
+  for (uint32 i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+    int p = shapes[i][0], c = shapes[i][1];
+    cout << p << "/" << c << "\t\t\t"
+         << RunQueueBench<AtomicQueue<Txn*> >(p, c, items) << "\t"
+         << RunQueueBench<LockFreeQueue<Txn*> >(p, c, items) << "\t";
+    if (p == 1 && c == 1)
+      cout << RunQueueBench<SPSCQueue<Txn*> >(p, c, items);
+    else
+      cout << "-";
+    cout << endl << flush;
+  }
+}
+
+// Task that only bumps a counter, so that pool overheads dominate.
+class CountTask : public Task {
+ public:
+  explicit CountTask(atomic_int* count) : count_(count) {}
+  virtual void Run() { (*count_)++; }
+ private:
+  atomic_int* count_;
+};
+
+// Prints the median and 99th percentile latency (in microseconds) of running
+// one task at a time on an otherwise idle 'tp', and the throughput (in tasks
+// per second) of a burst of tasks.
+void RunPoolBench(ThreadPool* tp) {
+  atomic_int count(0);
+  vector<double> latency;
+  for (int i = 1; i <= 5000; i++) {
+    double start = GetTime();
+    tp->RunTask(new CountTask(&count));
+    while (count < i) {}
+    latency.push_back((GetTime() - start) * 1000000);
+    // Let the workers go idle again.
+    if (i % 100 == 0)
+      usleep(1000);
+  }
+  sort(latency.begin(), latency.end());
+
+  int burst = 500000;
+  count = 0;
+  double start = GetTime();
+  for (int i = 0; i < burst; i++)
+    tp->RunTask(new CountTask(&count));
+  while (count < burst) {}
+  double throughput = burst / (GetTime() - start);
+
+  cout << latency[latency.size() / 2] << "\t\t"
+       << latency[latency.size() * 99 / 100] << "\t\t"
+       << throughput << endl << flush;
+}
+
+// Compares the polling StaticThreadPool with the WorkStealingThreadPool.
+void BenchmarkPools() {
+  cout << "pool			p50 (us)	p99 (us)	tasks/sec" << endl;
+  ThreadPool* tp = new StaticThreadPool(8);
+  cout << "StaticThreadPool	";
+  RunPoolBench(tp);
+  delete tp;
+  tp = new WorkStealingThreadPool(8);
+  cout << "WorkStealingPool	";
+  RunPoolBench(tp);
+  delete tp;
+}
+
+// Same as CountTask, but owned by the caller and reused.
+class EmbeddedCountTask : public CountTask {
+ public:
+  explicit EmbeddedCountTask(atomic_int* count) : CountTask(count) {}
+  virtual bool DeleteAfterRun() { return false; }
+};
+
+// Runs 'tasks' trivial tasks on 'tp', either heap-allocating each one or
+// reusing caller-owned tasks, and prints allocations per task and tasks/sec.
+void RunDispatchBench(ThreadPool* tp, bool embedded, int tasks) {
+  atomic_int count(0);
+  vector<EmbeddedCountTask*> owned;
+  for (int i = 0; i < 1024; i++)
+    owned.push_back(new EmbeddedCountTask(&count));
+
+  long before = Allocations();
+  double start = GetTime();
+  for (int i = 0; i < tasks; i++) {
+    if (embedded) {
+      // Recycle a task only once it has certainly run.
+      if (i >= 1024)
+        while (count <= i - 1024) {}
+      tp->RunTask(owned[i % 1024]);
+    } else {
+      tp->RunTask(new CountTask(&count));
+    }
+  }
+  while (count < tasks) {}
+  double end = GetTime();
+  cout << static_cast<double>(Allocations() - before) / tasks << "\t\t"
+       << tasks / (end - start) << endl << flush;
+
+  for (uint32 i = 0; i < owned.size(); i++)
+    delete owned[i];
+}
+
+// Compares per-task heap allocation with caller-owned (embedded) tasks on both
+// thread pools, then reports the allocations each TxnProcessor mode performs
+// per (empty) txn, excluding creating the txn itself.
+void BenchmarkAllocations() {
+  int tasks = 1000000;
+  cout << "dispatch			allocs/task	tasks/sec" << endl;
+  ThreadPool* pools[] = {new StaticThreadPool(8), new WorkStealingThreadPool(8)};
+  string names[] = {"StaticThreadPool", "WorkStealingPool"};
+  for (int i = 0; i < 2; i++) {
+    cout << names[i] << " new Task\t";
+    RunDispatchBench(pools[i], false, tasks);
+    cout << names[i] << " embedded\t";
+    RunDispatchBench(pools[i], true, tasks);
+    delete pools[i];
+  }
+
+  int num_txns = 100000;
+  cout << endl << "mode\t\tallocs/txn" << endl;
+  CCMode modes[] = {LOCKING, OCC, P_OCC, MVCC};
+  for (int m = 0; m < 4; m++) {
+    TxnProcessor* p = new TxnProcessor(modes[m]);
+    vector<Txn*> txns;
+    for (int i = 0; i < num_txns; i++)
+      txns.push_back(new Noop());
+
+    long before = Allocations();
+    for (int i = 0; i < num_txns; i++)
+      p->NewTxnRequest(txns[i]);
+    for (int i = 0; i < num_txns; i++)
+      p->GetTxnResult();
+    long after = Allocations();
+
+    cout << ModeToString(modes[m]) << "\t"
+         << static_cast<double>(after - before) / num_txns << endl << flush;
+    for (int i = 0; i < num_txns; i++)
+      delete txns[i];
+    delete p;
+  }
+}
+
+// Measures the latency of single MVCCStorage reads on a table of
+// MVCC_KEY_RANGE keys. Every key gets two more versions, at timestamps 1 and
+// 2, whose values form one random cycle through all keys, so each read
+// depends on the one before and the time per read is its full latency. The
+// versions are written in key order, so the cycle visits them in no
+// particular memory order either. Latest reads see the newest version; old
+// snapshot reads the one below it.
+void BenchmarkMVCCReads() {
+  MVCCStorage* storage = new MVCCStorage();
+  storage->InitStorage();
+  vector<Key> order(MVCC_KEY_RANGE);
+  for (Key i = 0; i < MVCC_KEY_RANGE; i++)
+    order[i] = i;
+  srand(42);
+  random_shuffle(order.begin(), order.end());
+  vector<Key> next(MVCC_KEY_RANGE);
+  for (Key i = 0; i < MVCC_KEY_RANGE; i++)
+    next[order[i]] = order[(i + 1) % MVCC_KEY_RANGE];
+  for (Key i = 0; i < MVCC_KEY_RANGE; i++) {
+    storage->Write(i, next[i], 1);
+    storage->Write(i, next[i], 2);
+  }
+
+  int reads = 5000000;
+  string names[] = {"Read, latest", "ReadSnapshot, latest",
+                    "ReadSnapshot, old"};
+  cout << "read			ns/read" << endl;
+  for (int m = 0; m < 3; m++) {
+    Value key = order[0];
+    double start = GetTime();
+    for (int i = 0; i < reads; i++) {
+      if (m == 0)
+        storage->Read(key, &key, 3);
+      else
+        storage->ReadSnapshot(key, &key, m == 1 ? 2 : 1);
+    }
+    double end = GetTime();
+    cout << names[m] << "\t" << (m == 0 ? "\t" : "")
+         << (end - start) * 1e9 / reads << endl << flush;
+  }
+  delete storage;
+}
+
+// Returns the resident set size of this process in kilobytes.
+long ResidentSetKB() {
+  long pages = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Runs the high contention write-only RMW workload in 'mode' for 'seconds'
+// seconds, keeping 'active_txns' txns in flight, and prints the RSS once per
+// second. In LOCKING mode lock requests are pooled and recycled, and in MVCC
+// mode old versions are garbage collected, so after warm-up the RSS should
+// stay flat. MVCC mode also prints the garbage collector's counters.
+void Soak(CCMode mode, int seconds) {
+  int active_txns = 100;
+  RMWLoadGen lg(100, 0, 5, 0);
+  TxnProcessor* p = new TxnProcessor(mode);
+
+  cout << "seconds\ttxns\t\tRSS (KB)";
+  if (mode == MVCC || mode == SSI)
+    cout << "\treclaimed (KB)\tmean chain\tmax chain";
+  cout << endl;
+  long txn_count = 0;
+  double start = GetTime();
+  double next_report = start + 1;
+  for (int i = 0; i < active_txns; i++)
+    p->NewTxnRequest(lg.NewTxn());
+  while (GetTime() < start + seconds) {
+    delete p->GetTxnResult();
+    txn_count++;
+    p->NewTxnRequest(lg.NewTxn());
+    if (GetTime() >= next_report) {
+      cout << static_cast<int>(next_report - start) << "\t" << txn_count
+           << "\t\t" << ResidentSetKB();
+      if (mode == MVCC || mode == SSI) {
+        MVCCGCStats stats = p->GarbageCollectionStats();
+        cout << "\t\t" << stats.reclaimed_bytes_ / 1024
+             << "\t\t" << stats.mean_chain_length_
+             << "\t\t" << stats.max_chain_length_;
+      }
+      cout << endl << flush;
+      next_report += 1;
+    }
+  }
+  for (int i = 0; i < active_txns; i++)
+    delete p->GetTxnResult();
+  delete p;
+}
+
 int main(int argc, char** argv) {
   // cout << "\t\t\t    Average Transaction Duration" << endl;
   // cout << "\t\t0.1ms\t\t1ms\t\t10ms";
   // cout << endl;
 
+  // Microbenchmarks, run as 'txn_processor_test <name>'.
+  if (argc > 1 && string(argv[1]) == "queues") {
+    BenchmarkQueues();
+    return 0;
+  }
+  if (argc > 1 && string(argv[1]) == "pools") {
+    BenchmarkPools();
+    return 0;
+  }
+  if (argc > 1 && string(argv[1]) == "allocs") {
+    count_allocations = true;
+    BenchmarkAllocations();
+    return 0;
+  }
+  if (argc > 1 && string(argv[1]) == "reads") {
+    BenchmarkMVCCReads();
+    return 0;
+  }
+  if (argc > 1 && string(argv[1]) == "soak") {
+    Soak(argc > 3 ? static_cast<CCMode>(atoi(argv[3])) : LOCKING,
+         argc > 2 ? atoi(argv[2]) : 60);
+    return 0;
+  }
+
   cpu_set_t cs;
   CPU_ZERO(&cs);
   CPU_SET(7, &cs);
@@ -332,7 +705,7 @@ int main(int argc, char** argv) {
     assert(false);
   }
 
-  cout << "workload\t\tLocking\t\tOCC\t\tOCC-P\t\tMVCC\t\tStrife"<<endl;
+  cout << "workload\t\tStrife\t\tStrife-P"<<endl;
 
   // RMW *t = new RMW(100, 0, 5, 0);
   // for (auto it = t->writeset_.begin(); it != t->writeset_.end(); ++it) {
@@ -33,6 +33,7 @@ class Expect : public Txn {
   Expect(const map<Key, Value>& m) : m_(m) {
     for (map<Key, Value>::iterator it = m_.begin(); it != m_.end(); ++it)
       readset_.insert(it->first);
+    read_only_ = true;
   }
 
   Expect* clone() const {             // Virtual constructor (copying)
@@ -84,12 +85,12 @@ class RMW : public Txn {
  public:
   explicit RMW(double time = 0) : time_(time) {}
   RMW(const set<Key>& writeset, double time = 0) : time_(time) {
-    writeset_ = writeset;
+    writeset_.insert(writeset.begin(), writeset.end());
   }
   RMW(const set<Key>& readset, const set<Key>& writeset, double time = 0)
       : time_(time) {
-    readset_ = readset;
-    writeset_ = writeset;
+    readset_.insert(readset.begin(), readset.end());
+    writeset_.insert(writeset.begin(), writeset.end());
   }
 
   // Constructor with randomized read/write sets
@@ -126,11 +127,11 @@ class RMW : public Txn {
   virtual void Run() {
     Value result;
     // Read everything in readset.
-    for (set<Key>::iterator it = readset_.begin(); it != readset_.end(); ++it)
+    for (KeySet::iterator it = readset_.begin(); it != readset_.end(); ++it)
       Read(*it, &result);
 
     // Increment length of everything in writeset.
-    for (set<Key>::iterator it = writeset_.begin(); it != writeset_.end();
+    for (KeySet::iterator it = writeset_.begin(); it != writeset_.end();
          ++it) {
       result = 0;
       Read(*it, &result);
@@ -159,12 +160,12 @@ class TPCC : public Txn {
  public:
   explicit TPCC(double time = 0) : time_(time) {}
   TPCC(const set<Key>& writeset, double time = 0) : time_(time) {
-    writeset_ = writeset;
+    writeset_.insert(writeset.begin(), writeset.end());
   }
   TPCC(const set<Key>& readset, const set<Key>& writeset, double time = 0)
       : time_(time) {
-    readset_ = readset;
-    writeset_ = writeset;
+    readset_.insert(readset.begin(), readset.end());
+    writeset_.insert(writeset.begin(), writeset.end());
   }
 
   // Constructor with randomized read/write sets
@@ -199,11 +200,11 @@ class TPCC : public Txn {
   virtual void Run() {
     Value result;
     // Read everything in readset.
-    for (set<Key>::iterator it = readset_.begin(); it != readset_.end(); ++it)
+    for (KeySet::iterator it = readset_.begin(); it != readset_.end(); ++it)
       Read(*it, &result);
 
     // Increment length of everything in writeset.
-    for (set<Key>::iterator it = writeset_.begin(); it != writeset_.end();
+    for (KeySet::iterator it = writeset_.begin(); it != writeset_.end();
          ++it) {
       result = 0;
       Read(*it, &result);
@@ -237,7 +238,7 @@ class TPCC : public Txn {
     // writeset_.insert(district_key-1);
     writeset_.insert(district_key);
     writeset_.insert(rand() % oorder_ + (dbsize_ * 0.28));
-    set<Key> keys;
+    KeySet keys;
     Key item_key;
     for (int i=0; i<num_keys; i++) {
       do {
@@ -278,7 +279,7 @@ class TPCC : public Txn {
   void OrderStatus() {
     readset_.insert(rand()%oorder_ + (dbsize_*0.28));
     int num_orderline = rand() % 11 + 5;
-    set<Key> orderline_keys;
+    KeySet orderline_keys;
     Key orderline_key;
     for (int i=0; i<num_orderline; i++) {
       do {
@@ -298,7 +299,7 @@ class TPCC : public Txn {
     writeset_.insert(oorder_key);
     readset_.insert(oorder_key+1);
     int num_orderline = rand() % 11 + 5;
-    set<Key> orderline_keys;
+    KeySet orderline_keys;
     Key orderline_key;
     for (int i=0; i<num_orderline; i++) {
       do {
@@ -314,7 +315,7 @@ class TPCC : public Txn {
   void StockLevel() {
     readset_.insert(rand() % 10 + dbsize_);
     int num_orderline = rand() % 21 + 1;
-    set<Key> orderline_keys;
+    KeySet orderline_keys;
     Key orderline_key;
     for (int i=0; i<num_orderline; i++) {
       do {
@@ -331,12 +332,12 @@ class YCSB : public Txn {
  public:
   explicit YCSB(double time = 0) : time_(time) {}
   YCSB(const set<Key>& writeset, double time = 0) : time_(time) {
-    writeset_ = writeset;
+    writeset_.insert(writeset.begin(), writeset.end());
   }
   YCSB(const set<Key>& readset, const set<Key>& writeset, double time = 0)
       : time_(time) {
-    readset_ = readset;
-    writeset_ = writeset;
+    readset_.insert(readset.begin(), readset.end());
+    writeset_.insert(writeset.begin(), writeset.end());
   }
 
   // Constructor with randomized read/write sets
@@ -361,11 +362,11 @@ class YCSB : public Txn {
   virtual void Run() {
     Value result;
     // Read everything in readset.
-    for (set<Key>::iterator it = readset_.begin(); it != readset_.end(); ++it)
+    for (KeySet::iterator it = readset_.begin(); it != readset_.end(); ++it)
       Read(*it, &result);
 
     // Increment length of everything in writeset.
-    for (set<Key>::iterator it = writeset_.begin(); it != writeset_.end();
+    for (KeySet::iterator it = writeset_.begin(); it != writeset_.end();
          ++it) {
       result = 0;
       Read(*it, &result);
@@ -394,7 +395,7 @@ class YCSB : public Txn {
 
   void WorkloadA() {
     int num = rand() % 100 + 1;
-    set<Key> *s;
+    KeySet *s;
     if (num >= 1 and num <= 50)
       s = &readset_;
     else
@@ -410,7 +411,7 @@ class YCSB : public Txn {
 
   void WorkloadB() {
     int num = rand() % 100 + 1;
-    set<Key> *s;
+    KeySet *s;
     if (num >= 1 and num <= 95)
       s = &readset_;
     else
@@ -432,6 +433,7 @@ class YCSB : public Txn {
       } while (readset_.count(k));
       readset_.insert(k);
     }
+    read_only_ = true;
   }
 
   void WorkloadE() {
@@ -47,6 +47,11 @@ class Condition {
     m_->Unlock();
   }
 
+  /// Same as Signal(), for a caller that already holds the associated mutex.
+  inline void SignalHeld() {
+    pthread_cond_signal(&cv_);
+  }
+
 #define WAIT_WHILE(a) \
   m_->Lock(); \
   while (a) \
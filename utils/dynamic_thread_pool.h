@@ -41,6 +41,10 @@ class DynamicThreadPool : public ThreadPool {
 
   virtual int ThreadCount() { return *thread_count_; }
 
+  // Threads are created on demand and never torn down.
+  virtual bool Active() { return true; }
+  virtual void Stop() {}
+
  private:
   class Thread {
    public:
@@ -69,10 +73,12 @@ class DynamicThreadPool : public ThreadPool {
       while (true) {
         // Run task_ any time it's not NULL.
         cv_.WaitWhileEq<Task*>(NULL, &task_);
+        bool owned = task_->DeleteAfterRun();
         task_->Run();
 
         // 
-        delete task_;
+        if (owned)
+          delete task_;
         task_ = NULL;
         thread_pool_->available_threads_.Push(this);
       }
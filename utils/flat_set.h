@@ -0,0 +1,259 @@
+
+#ifndef _DB_UTILS_FLAT_SET_H_
+#define _DB_UTILS_FLAT_SET_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+using std::pair;
+
+// Number of elements FlatSet and FlatMap store inline before moving to the
+// heap.
+#define FLAT_INLINE_CAPACITY 16
+
+/// @class FlatSet<T, N>
+///
+/// Ordered set of simple (memcpy-able) values kept as a sorted contiguous
+/// array. The first N elements live inside the object itself, so small sets
+/// never allocate; larger sets move to a heap array that doubles as needed.
+///
+/// Offers the subset of the std::set<T> interface used for txn read/write
+/// sets. Iterators (plain pointers) are invalidated by insert(), erase() and
+/// clear().
+template<typename T, int N = FLAT_INLINE_CAPACITY>
+class FlatSet {
+ public:
+  typedef const T* iterator;
+  typedef const T* const_iterator;
+
+  FlatSet() : data_(inline_), size_(0), capacity_(N) {}
+
+  FlatSet(const FlatSet& other) : data_(inline_), size_(0), capacity_(N) {
+    *this = other;
+  }
+
+  FlatSet& operator=(const FlatSet& other) {
+    if (this != &other) {
+      Reserve(other.size_);
+      memcpy(data_, other.data_, sizeof(T) * other.size_);
+      size_ = other.size_;
+    }
+    return *this;
+  }
+
+  ~FlatSet() {
+    if (data_ != inline_)
+      free(data_);
+  }
+
+  iterator begin() const { return data_; }
+  iterator end() const { return data_ + size_; }
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns an iterator to 'value', or end() if it is not in the set.
+  iterator find(const T& value) const {
+    const T* pos = LowerBound(value);
+    return (pos != end() && *pos == value) ? pos : end();
+  }
+
+  int count(const T& value) const { return find(value) != end() ? 1 : 0; }
+
+  // Inserts 'value' if it is not present yet. Returns its position and
+  // whether it was inserted.
+  pair<iterator, bool> insert(const T& value) {
+    int i = LowerBound(value) - data_;
+    if (i < size_ && data_[i] == value)
+      return pair<iterator, bool>(data_ + i, false);
+    Reserve(size_ + 1);
+    memmove(data_ + i + 1, data_ + i, sizeof(T) * (size_ - i));
+    data_[i] = value;
+    size_++;
+    return pair<iterator, bool>(data_ + i, true);
+  }
+
+  template<typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    for (; first != last; ++first)
+      insert(*first);
+  }
+
+  // Removes 'value' if it is present. Returns the number of elements removed.
+  int erase(const T& value) {
+    int i = LowerBound(value) - data_;
+    if (i == size_ || !(data_[i] == value))
+      return 0;
+    memmove(data_ + i, data_ + i + 1, sizeof(T) * (size_ - i - 1));
+    size_--;
+    return 1;
+  }
+
+  void clear() { size_ = 0; }
+
+ private:
+  const T* LowerBound(const T& value) const {
+    return std::lower_bound(data_, data_ + size_, value);
+  }
+
+  // Makes room for at least 'n' elements.
+  void Reserve(int n) {
+    if (n <= capacity_)
+      return;
+    int capacity = capacity_;
+    while (capacity < n)
+      capacity *= 2;
+    T* data = reinterpret_cast<T*>(malloc(sizeof(T) * capacity));
+    memcpy(data, data_, sizeof(T) * size_);
+    if (data_ != inline_)
+      free(data_);
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  T* data_;
+  int size_;
+  int capacity_;
+  T inline_[N];
+};
+
+/// @class FlatMap<K, V, N>
+///
+/// Ordered map from simple keys to simple values, kept as a sorted contiguous
+/// key array and a parallel value array, with the first N entries stored
+/// inline (see FlatSet).
+///
+/// Offers the subset of the std::map<K, V> interface used for txn read/write
+/// results. Dereferencing an iterator yields a proxy with 'first' and 'second'
+/// members referring into the arrays.
+template<typename K, typename V, int N = FLAT_INLINE_CAPACITY>
+class FlatMap {
+ public:
+  struct Entry {
+    const K& first;
+    V& second;
+    Entry* operator->() { return this; }
+  };
+
+  class iterator {
+   public:
+    iterator(const K* key, V* value) : key_(key), value_(value) {}
+    Entry operator*() const { Entry e = {*key_, *value_}; return e; }
+    Entry operator->() const { return **this; }
+    iterator& operator++() { ++key_; ++value_; return *this; }
+    iterator operator++(int) { iterator old = *this; ++*this; return old; }
+    bool operator==(const iterator& other) const { return key_ == other.key_; }
+    bool operator!=(const iterator& other) const { return key_ != other.key_; }
+
+   private:
+    const K* key_;
+    V* value_;
+  };
+
+  FlatMap() : keys_(inline_keys_), values_(inline_values_), size_(0),
+              capacity_(N) {}
+
+  FlatMap(const FlatMap& other)
+      : keys_(inline_keys_), values_(inline_values_), size_(0), capacity_(N) {
+    *this = other;
+  }
+
+  FlatMap& operator=(const FlatMap& other) {
+    if (this != &other) {
+      Reserve(other.size_);
+      memcpy(keys_, other.keys_, sizeof(K) * other.size_);
+      memcpy(values_, other.values_, sizeof(V) * other.size_);
+      size_ = other.size_;
+    }
+    return *this;
+  }
+
+  ~FlatMap() {
+    if (keys_ != inline_keys_) {
+      free(keys_);
+      free(values_);
+    }
+  }
+
+  iterator begin() { return iterator(keys_, values_); }
+  iterator end() { return iterator(keys_ + size_, values_ + size_); }
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  iterator find(const K& key) {
+    int i = LowerBound(key);
+    return (i < size_ && keys_[i] == key) ? iterator(keys_ + i, values_ + i)
+                                          : end();
+  }
+
+  int count(const K& key) const {
+    int i = LowerBound(key);
+    return (i < size_ && keys_[i] == key) ? 1 : 0;
+  }
+
+  // Returns the value mapped to 'key', inserting a value-initialized one if
+  // 'key' is not present yet.
+  V& operator[](const K& key) {
+    int i = LowerBound(key);
+    if (i < size_ && keys_[i] == key)
+      return values_[i];
+    Reserve(size_ + 1);
+    memmove(keys_ + i + 1, keys_ + i, sizeof(K) * (size_ - i));
+    memmove(values_ + i + 1, values_ + i, sizeof(V) * (size_ - i));
+    keys_[i] = key;
+    values_[i] = V();
+    size_++;
+    return values_[i];
+  }
+
+  // Removes the entry for 'key' if there is one. Returns the number of
+  // entries removed.
+  int erase(const K& key) {
+    int i = LowerBound(key);
+    if (i == size_ || !(keys_[i] == key))
+      return 0;
+    memmove(keys_ + i, keys_ + i + 1, sizeof(K) * (size_ - i - 1));
+    memmove(values_ + i, values_ + i + 1, sizeof(V) * (size_ - i - 1));
+    size_--;
+    return 1;
+  }
+
+  void clear() { size_ = 0; }
+
+ private:
+  int LowerBound(const K& key) const {
+    return std::lower_bound(keys_, keys_ + size_, key) - keys_;
+  }
+
+  // Makes room for at least 'n' entries.
+  void Reserve(int n) {
+    if (n <= capacity_)
+      return;
+    int capacity = capacity_;
+    while (capacity < n)
+      capacity *= 2;
+    K* keys = reinterpret_cast<K*>(malloc(sizeof(K) * capacity));
+    V* values = reinterpret_cast<V*>(malloc(sizeof(V) * capacity));
+    memcpy(keys, keys_, sizeof(K) * size_);
+    memcpy(values, values_, sizeof(V) * size_);
+    if (keys_ != inline_keys_) {
+      free(keys_);
+      free(values_);
+    }
+    keys_ = keys;
+    values_ = values;
+    capacity_ = capacity;
+  }
+
+  K* keys_;
+  V* values_;
+  int size_;
+  int capacity_;
+  K inline_keys_[N];
+  V inline_values_[N];
+};
+
+#endif  // _DB_UTILS_FLAT_SET_H_
@@ -0,0 +1,235 @@
+#include "utils/flat_set.h"
+
+#include <map>
+#include <set>
+
+#include "utils/testing.h"
+
+using std::map;
+using std::set;
+
+// Returns true iff 'flat' holds exactly the elements of 'expected', in order.
+bool SameElements(const FlatSet<int>& flat, const set<int>& expected) {
+  if (flat.size() != static_cast<int>(expected.size()))
+    return false;
+  set<int>::const_iterator it = expected.begin();
+  for (FlatSet<int>::iterator f = flat.begin(); f != flat.end(); ++f, ++it) {
+    if (*f != *it)
+      return false;
+  }
+  return true;
+}
+
+// Same for maps.
+bool SameEntries(FlatMap<int, int>* flat, const map<int, int>& expected) {
+  if (flat->size() != static_cast<int>(expected.size()))
+    return false;
+  map<int, int>::const_iterator it = expected.begin();
+  for (FlatMap<int, int>::iterator f = flat->begin(); f != flat->end();
+       ++f, ++it) {
+    if (f->first != it->first || f->second != it->second)
+      return false;
+  }
+  return true;
+}
+
+// Keys in scrambled order: 37 is coprime to 101, so 0..100 each come up once.
+int Scrambled(int i) {
+  return (i * 37) % 101;
+}
+
+TEST(FlatSet_OrderedAcrossInlineAndHeap) {
+  FlatSet<int> flat;
+  set<int> expected;
+  EXPECT_TRUE(flat.empty());
+
+  // Sizes 16 and 17 cross from the inline array to the heap.
+  bool same = true;
+  for (int i = 0; i < 101; i++) {
+    int key = Scrambled(i);
+    EXPECT_TRUE(flat.insert(key).second);
+    expected.insert(key);
+    same = same && SameElements(flat, expected);
+  }
+  EXPECT_TRUE(same);
+
+  // Inserting a present value changes nothing.
+  pair<FlatSet<int>::iterator, bool> result = flat.insert(50);
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(50, *result.first);
+  EXPECT_EQ(101, flat.size());
+
+  flat.clear();
+  EXPECT_TRUE(flat.empty());
+  EXPECT_TRUE(flat.begin() == flat.end());
+
+  END;
+}
+
+TEST(FlatSet_CountFindErase) {
+  FlatSet<int> flat;
+  set<int> expected;
+  for (int i = 0; i < 40; i += 2) {
+    flat.insert(i);
+    expected.insert(i);
+  }
+
+  EXPECT_EQ(1, flat.count(10));
+  EXPECT_EQ(0, flat.count(11));
+  EXPECT_EQ(0, flat.count(100));
+  EXPECT_EQ(10, *flat.find(10));
+  EXPECT_TRUE(flat.find(11) == flat.end());
+
+  // Erase the first, the last, a middle and a missing element, on the heap.
+  EXPECT_EQ(1, flat.erase(0));
+  EXPECT_EQ(1, flat.erase(38));
+  EXPECT_EQ(1, flat.erase(20));
+  EXPECT_EQ(0, flat.erase(21));
+  expected.erase(0);
+  expected.erase(38);
+  expected.erase(20);
+  EXPECT_TRUE(SameElements(flat, expected));
+  EXPECT_EQ(0, flat.count(20));
+
+  // Erase down into the inline range, then grow past it again.
+  for (int i = 2; i < 20; i += 2) {
+    flat.erase(i);
+    expected.erase(i);
+  }
+  EXPECT_TRUE(SameElements(flat, expected));
+  for (int i = 1; i < 40; i += 2) {
+    flat.insert(i);
+    expected.insert(i);
+  }
+  EXPECT_TRUE(SameElements(flat, expected));
+
+  END;
+}
+
+TEST(FlatSet_Copy) {
+  FlatSet<int> small, large;
+  set<int> small_expected, large_expected;
+  for (int i = 0; i < 5; i++) {
+    small.insert(Scrambled(i));
+    small_expected.insert(Scrambled(i));
+  }
+  for (int i = 0; i < 50; i++) {
+    large.insert(Scrambled(i));
+    large_expected.insert(Scrambled(i));
+  }
+
+  FlatSet<int> small_copy(small);
+  FlatSet<int> large_copy(large);
+  EXPECT_TRUE(SameElements(small_copy, small_expected));
+  EXPECT_TRUE(SameElements(large_copy, large_expected));
+
+  // Copies do not share storage with the original.
+  large_copy.insert(1000);
+  large_copy.erase(Scrambled(0));
+  EXPECT_TRUE(SameElements(large, large_expected));
+  small_copy.insert(1000);
+  EXPECT_TRUE(SameElements(small, small_expected));
+
+  // Assignment in both directions between inline and heap storage.
+  small_copy = large;
+  EXPECT_TRUE(SameElements(small_copy, large_expected));
+  large_copy = small;
+  EXPECT_TRUE(SameElements(large_copy, small_expected));
+  large_copy = large_copy;
+  EXPECT_TRUE(SameElements(large_copy, small_expected));
+
+  END;
+}
+
+TEST(FlatMap_OrderedAcrossInlineAndHeap) {
+  FlatMap<int, int> flat;
+  map<int, int> expected;
+
+  bool same = true;
+  for (int i = 0; i < 101; i++) {
+    int key = Scrambled(i);
+    flat[key] = i;
+    expected[key] = i;
+    same = same && SameEntries(&flat, expected);
+  }
+  EXPECT_TRUE(same);
+
+  // operator[] on a missing key inserts a zero value; on a present key it
+  // returns the existing one.
+  EXPECT_EQ(0, flat[500]);
+  EXPECT_EQ(102, flat.size());
+  flat[500] += 7;
+  EXPECT_EQ(7, flat[500]);
+  EXPECT_EQ(102, flat.size());
+  expected[500] = 7;
+  EXPECT_TRUE(SameEntries(&flat, expected));
+
+  flat.clear();
+  EXPECT_TRUE(flat.empty());
+  EXPECT_TRUE(flat.begin() == flat.end());
+
+  END;
+}
+
+TEST(FlatMap_CountFindErase) {
+  FlatMap<int, int> flat;
+  map<int, int> expected;
+  for (int i = 0; i < 40; i++) {
+    flat[i] = i * i;
+    expected[i] = i * i;
+  }
+
+  EXPECT_EQ(1, flat.count(39));
+  EXPECT_EQ(0, flat.count(40));
+  EXPECT_EQ(81, flat.find(9)->second);
+  EXPECT_TRUE(flat.find(-1) == flat.end());
+
+  // Erasing keeps keys and values paired.
+  EXPECT_EQ(1, flat.erase(0));
+  EXPECT_EQ(1, flat.erase(20));
+  EXPECT_EQ(1, flat.erase(39));
+  EXPECT_EQ(0, flat.erase(20));
+  expected.erase(0);
+  expected.erase(20);
+  expected.erase(39);
+  EXPECT_TRUE(SameEntries(&flat, expected));
+  EXPECT_EQ(441, flat[21]);
+
+  END;
+}
+
+TEST(FlatMap_Copy) {
+  FlatMap<int, int> small, large;
+  map<int, int> small_expected, large_expected;
+  for (int i = 0; i < 5; i++) {
+    small[i] = -i;
+    small_expected[i] = -i;
+  }
+  for (int i = 0; i < 50; i++) {
+    large[Scrambled(i)] = i;
+    large_expected[Scrambled(i)] = i;
+  }
+
+  FlatMap<int, int> large_copy(large);
+  EXPECT_TRUE(SameEntries(&large_copy, large_expected));
+  large_copy[Scrambled(0)] = 1000;
+  large_copy.erase(Scrambled(1));
+  EXPECT_TRUE(SameEntries(&large, large_expected));
+
+  FlatMap<int, int> small_copy(small);
+  small_copy = large;
+  EXPECT_TRUE(SameEntries(&small_copy, large_expected));
+  large_copy = small;
+  EXPECT_TRUE(SameEntries(&large_copy, small_expected));
+
+  END;
+}
+
+int main(int argc, char** argv) {
+  FlatSet_OrderedAcrossInlineAndHeap();
+  FlatSet_CountFindErase();
+  FlatSet_Copy();
+  FlatMap_OrderedAcrossInlineAndHeap();
+  FlatMap_CountFindErase();
+  FlatMap_Copy();
+}
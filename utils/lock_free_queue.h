@@ -0,0 +1,446 @@
+
+#ifndef _DB_UTILS_LOCK_FREE_QUEUE_H_
+#define _DB_UTILS_LOCK_FREE_QUEUE_H_
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#define QUEUE_CACHE_LINE 64
+
+// Default number of slots in a ring queue. LockFreeQueue and SPSCQueue are
+// bounded: their Push waits for a consumer to free a slot once this many items
+// are queued.
+#define DEFAULT_RING_CAPACITY (1 << 18)
+
+// Maximum number of slots that LockFreeQueue::PushMany claims at once.
+#define PUSH_MANY_CHUNK 64
+
+// Rounds 'n' up to the next power of two.
+static inline size_t RoundUpPowerOfTwo(size_t n) {
+  size_t capacity = 1;
+  while (capacity < n)
+    capacity <<= 1;
+  return capacity;
+}
+
+/// @class LockFreeQueue<T>
+///
+/// Bounded multi-producer/multi-consumer FIFO queue. Implemented as a ring of
+/// slots, each carrying a sequence number that tells producers and consumers
+/// whether the slot is ready for them (Vyukov's bounded MPMC queue), so that
+/// push and pop each cost a single CAS on an uncontended cache line.
+///
+/// Offers the same interface as AtomicQueue<T>. T is required to be a simple
+/// copyable type (in practice, a pointer).
+template<typename T>
+class LockFreeQueue {
+ public:
+  explicit LockFreeQueue(size_t capacity = DEFAULT_RING_CAPACITY)
+      : capacity_(RoundUpPowerOfTwo(capacity)), mask_(capacity_ - 1) {
+    cells_ = new Cell[capacity_];
+    for (size_t i = 0; i < capacity_; i++)
+      cells_[i].sequence_.store(i, std::memory_order_relaxed);
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  ~LockFreeQueue() {
+    delete[] cells_;
+  }
+
+  // Returns the number of elements currently in the queue. Only a snapshot
+  // when other threads are pushing or popping concurrently.
+  int Size() {
+    size_t tail = enqueue_pos_.load(std::memory_order_acquire);
+    size_t head = dequeue_pos_.load(std::memory_order_acquire);
+    return tail > head ? static_cast<int>(tail - head) : 0;
+  }
+
+  // Atomically pushes 'item' onto the queue, waiting for a free slot if the
+  // queue is full.
+  void Push(const T& item) {
+    while (!PushNonBlocking(item))
+      sched_yield();
+  }
+
+  // If the queue is non-empty, (atomically) sets '*result' equal to the front
+  // element, pops the front element from the queue, and returns true,
+  // otherwise returns false.
+  bool Pop(T* result) {
+    Cell* cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence_.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) -
+                      static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        // Slot has not been filled yet: the queue is empty.
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    *result = cell->data_;
+    cell->sequence_.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  // If the queue has a free slot, pushes and returns true, else immediately
+  // returns false.
+  bool PushNonBlocking(const T& item) {
+    Cell* cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence_.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) -
+                      static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        // Slot has not been consumed yet: the queue is full.
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data_ = item;
+    cell->sequence_.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Synonym for 'Pop(result)', which never blocks.
+  bool PopNonBlocking(T* result) {
+    return Pop(result);
+  }
+
+  // Pushes the 'count' items starting at 'items' onto the queue, in order.
+  // Claims up to PUSH_MANY_CHUNK consecutive slots with a single CAS, and only
+  // falls back to pushing one item at a time when the ring is nearly full.
+  void PushMany(const T* items, size_t count) {
+    while (count > 0) {
+      size_t n = count < PUSH_MANY_CHUNK ? count : PUSH_MANY_CHUNK;
+      size_t pos;
+      if (ClaimSlots(n, &pos)) {
+        for (size_t i = 0; i < n; i++) {
+          Cell* cell = &cells_[(pos + i) & mask_];
+          cell->data_ = items[i];
+          cell->sequence_.store(pos + i + 1, std::memory_order_release);
+        }
+      } else {
+        n = 1;
+        Push(items[0]);
+      }
+      items += n;
+      count -= n;
+    }
+  }
+
+ private:
+  // Claims the 'n' consecutive slots starting at '*first', if they are all
+  // free. Returns false if some of the next 'n' slots are still occupied.
+  bool ClaimSlots(size_t n, size_t* first) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      bool free = true;
+      for (size_t i = 0; i < n && free; i++) {
+        size_t sequence =
+            cells_[(pos + i) & mask_].sequence_.load(std::memory_order_acquire);
+        free = (sequence == pos + i);
+      }
+      if (!free) {
+        // Either the ring is (nearly) full, or another producer moved on.
+        size_t now = enqueue_pos_.load(std::memory_order_relaxed);
+        if (now == pos)
+          return false;
+        pos = now;
+      } else if (enqueue_pos_.compare_exchange_weak(
+                     pos, pos + n, std::memory_order_relaxed)) {
+        *first = pos;
+        return true;
+      }
+    }
+  }
+
+  struct Cell {
+    std::atomic<size_t> sequence_;
+    T data_;
+  };
+
+  // Producers and consumers each hammer their own position counter, so keep
+  // them (and the read-only ring description) on separate cache lines.
+  char pad0_[QUEUE_CACHE_LINE];
+  Cell* cells_;
+  const size_t capacity_;
+  const size_t mask_;
+  char pad1_[QUEUE_CACHE_LINE];
+  std::atomic<size_t> enqueue_pos_;
+  char pad2_[QUEUE_CACHE_LINE];
+  std::atomic<size_t> dequeue_pos_;
+  char pad3_[QUEUE_CACHE_LINE];
+
+  // DISALLOW COPY AND ASSIGN
+  LockFreeQueue(const LockFreeQueue&);
+  LockFreeQueue& operator=(const LockFreeQueue&);
+};
+
+/// @class SPSCQueue<T>
+///
+/// Bounded FIFO queue for exactly one producer thread and one consumer thread.
+/// Push and pop are a plain load and a release store of the producer's or
+/// consumer's own index; each side caches the other side's index and only
+/// re-reads it when the ring looks full (or empty).
+///
+/// Offers the same interface as AtomicQueue<T>, but calling Push from more
+/// than one thread (or Pop from more than one thread) is NOT allowed.
+template<typename T>
+class SPSCQueue {
+ public:
+  explicit SPSCQueue(size_t capacity = DEFAULT_RING_CAPACITY)
+      : capacity_(RoundUpPowerOfTwo(capacity)), mask_(capacity_ - 1),
+        cached_tail_(0), cached_head_(0) {
+    items_ = new T[capacity_];
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+  }
+
+  ~SPSCQueue() {
+    delete[] items_;
+  }
+
+  // Returns the number of elements currently in the queue.
+  int Size() {
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t head = head_.load(std::memory_order_acquire);
+    return static_cast<int>(tail - head);
+  }
+
+  // Pushes 'item' onto the queue, waiting for a free slot if the queue is
+  // full. Producer thread only.
+  void Push(const T& item) {
+    while (!PushNonBlocking(item))
+      sched_yield();
+  }
+
+  // If the queue is non-empty, sets '*result' equal to the front element, pops
+  // the front element from the queue, and returns true, otherwise returns
+  // false. Consumer thread only.
+  bool Pop(T* result) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_)
+        return false;
+    }
+    *result = items_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // If the queue has a free slot, pushes and returns true, else immediately
+  // returns false. Producer thread only.
+  bool PushNonBlocking(const T& item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == capacity_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == capacity_)
+        return false;
+    }
+    items_[tail & mask_] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Synonym for 'Pop(result)', which never blocks.
+  bool PopNonBlocking(T* result) {
+    return Pop(result);
+  }
+
+ private:
+  char pad0_[QUEUE_CACHE_LINE];
+  T* items_;
+  const size_t capacity_;
+  const size_t mask_;
+  char pad1_[QUEUE_CACHE_LINE];
+
+  // Consumer side: next slot to pop, and the producer's index as last seen.
+  std::atomic<size_t> head_;
+  size_t cached_tail_;
+  char pad2_[QUEUE_CACHE_LINE];
+
+  // Producer side: next slot to fill, and the consumer's index as last seen.
+  std::atomic<size_t> tail_;
+  size_t cached_head_;
+  char pad3_[QUEUE_CACHE_LINE];
+
+  // DISALLOW COPY AND ASSIGN
+  SPSCQueue(const SPSCQueue&);
+  SPSCQueue& operator=(const SPSCQueue&);
+};
+
+// Number of times a blocking pop retries before going to sleep.
+#define BLOCKING_POP_SPIN_ROUNDS 256
+
+/// @class BlockingQueue<T>
+///
+/// Unbounded FIFO queue whose consumers can also wait for an element to
+/// arrive, sleeping on a condition variable (with an optional timeout) instead
+/// of polling. Elements normally go through a LockFreeQueue<T> of 'capacity'
+/// slots; once that ring is full, pushes spill into a mutex-guarded overflow
+/// list instead of waiting, so a producer never blocks on a slow consumer.
+/// Pushes only touch the condition variable when some consumer is actually
+/// asleep.
+template<typename T>
+class BlockingQueue {
+ public:
+  explicit BlockingQueue(size_t capacity = DEFAULT_RING_CAPACITY)
+      : queue_(capacity), overflow_size_(0), waiters_(0) {
+    pthread_mutex_init(&overflow_mutex_, NULL);
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+  }
+
+  ~BlockingQueue() {
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+    pthread_mutex_destroy(&overflow_mutex_);
+  }
+
+  int Size() { return queue_.Size() + overflow_size_.load(); }
+
+  // Pushes 'item' without ever waiting. While the overflow list is in use,
+  // later items go there too, behind the ones already waiting in it.
+  void Push(const T& item) {
+    if (overflow_size_.load() > 0 || !queue_.PushNonBlocking(item)) {
+      pthread_mutex_lock(&overflow_mutex_);
+      overflow_.push_back(item);
+      overflow_size_.fetch_add(1);
+      pthread_mutex_unlock(&overflow_mutex_);
+    }
+    Notify();
+  }
+
+  // Same as 'Push(item)'; always succeeds.
+  bool PushNonBlocking(const T& item) {
+    Push(item);
+    return true;
+  }
+
+  // If the queue is non-empty, sets '*result' equal to the front element,
+  // pops it, and returns true, otherwise returns false. Ring elements were all
+  // queued before any element still in the overflow list, so they go first.
+  bool Pop(T* result) {
+    if (queue_.Pop(result))
+      return true;
+    if (overflow_size_.load() == 0)
+      return false;
+    bool popped = false;
+    pthread_mutex_lock(&overflow_mutex_);
+    if (!overflow_.empty()) {
+      *result = overflow_.front();
+      overflow_.pop_front();
+      overflow_size_.fetch_sub(1);
+      popped = true;
+    }
+    pthread_mutex_unlock(&overflow_mutex_);
+    return popped;
+  }
+
+  bool PopNonBlocking(T* result) { return Pop(result); }
+
+  // Pops the front element into '*result', waiting for one to be pushed if
+  // the queue is empty. Gives up and returns false after 'timeout' seconds;
+  // a negative 'timeout' waits forever.
+  bool PopBlocking(T* result, double timeout = -1) {
+    for (int i = 0; i < BLOCKING_POP_SPIN_ROUNDS; i++) {
+      if (Pop(result))
+        return true;
+    }
+
+    struct timespec deadline;
+    if (timeout >= 0) {
+      struct timeval now;
+      gettimeofday(&now, NULL);
+      double end = now.tv_sec + now.tv_usec / 1e6 + timeout;
+      deadline.tv_sec = static_cast<time_t>(end);
+      deadline.tv_nsec = static_cast<long>((end - deadline.tv_sec) * 1e9);
+    }
+
+    bool popped = false;
+    pthread_mutex_lock(&mutex_);
+    waiters_.fetch_add(1);
+    while (!(popped = Pop(result))) {
+      if (timeout < 0) {
+        pthread_cond_wait(&cond_, &mutex_);
+      } else if (pthread_cond_timedwait(&cond_, &mutex_, &deadline) != 0) {
+        // Timed out; take one last look.
+        popped = Pop(result);
+        break;
+      }
+    }
+    waiters_.fetch_sub(1);
+    pthread_mutex_unlock(&mutex_);
+    return popped;
+  }
+
+  // Waits (as PopBlocking) for at least one element, then appends it and up to
+  // 'max' - 1 further elements that are already queued to '*results'. Returns
+  // the number of elements appended.
+  int PopMany(std::vector<T>* results, int max, double timeout = -1) {
+    T item;
+    if (max <= 0 || !PopBlocking(&item, timeout))
+      return 0;
+    results->push_back(item);
+    int count = 1;
+    while (count < max && Pop(&item)) {
+      results->push_back(item);
+      count++;
+    }
+    return count;
+  }
+
+ private:
+  // Wakes a sleeping consumer, if there is one. The fence orders the push
+  // before the read of 'waiters_', pairing with the consumer's increment of
+  // 'waiters_' before its last Pop attempt, so a wakeup is never lost.
+  void Notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load() > 0) {
+      pthread_mutex_lock(&mutex_);
+      pthread_cond_signal(&cond_);
+      pthread_mutex_unlock(&mutex_);
+    }
+  }
+
+  LockFreeQueue<T> queue_;
+
+  // Elements pushed while the ring was full (or while earlier ones were still
+  // waiting here), oldest first, and their number.
+  std::deque<T> overflow_;
+  std::atomic<int> overflow_size_;
+  pthread_mutex_t overflow_mutex_;
+
+  std::atomic<int> waiters_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+
+  // DISALLOW COPY AND ASSIGN
+  BlockingQueue(const BlockingQueue&);
+  BlockingQueue& operator=(const BlockingQueue&);
+};
+
+#endif  // _DB_UTILS_LOCK_FREE_QUEUE_H_
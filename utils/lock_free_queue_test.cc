@@ -0,0 +1,346 @@
+#include "utils/lock_free_queue.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "utils/mutex.h"
+#include "utils/testing.h"
+
+using std::vector;
+
+TEST(LockFreeQueue_FullAndEmpty) {
+  LockFreeQueue<int> q(3);  // Rounded up to 4 slots.
+  int x;
+
+  EXPECT_FALSE(q.Pop(&x));
+  EXPECT_EQ(0, q.Size());
+
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(q.PushNonBlocking(i));
+  EXPECT_FALSE(q.PushNonBlocking(4));
+  EXPECT_EQ(4, q.Size());
+
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(q.Pop(&x));
+    EXPECT_EQ(i, x);
+  }
+  EXPECT_FALSE(q.Pop(&x));
+  EXPECT_EQ(0, q.Size());
+
+  END;
+}
+
+TEST(LockFreeQueue_Wraparound) {
+  LockFreeQueue<int> q(8);
+  int x;
+
+  // Each round starts at a different slot, so the ring wraps many times.
+  int next = 0, expected = 0;
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < 5; i++)
+      EXPECT_TRUE(q.PushNonBlocking(next++));
+    EXPECT_EQ(5, q.Size());
+    for (int i = 0; i < 5; i++) {
+      EXPECT_TRUE(q.Pop(&x));
+      EXPECT_EQ(expected++, x);
+    }
+  }
+
+  // PushMany across the end of the ring, filling it completely.
+  int items[8];
+  for (int i = 0; i < 8; i++)
+    items[i] = next++;
+  q.PushMany(items, 8);
+  EXPECT_EQ(8, q.Size());
+  EXPECT_FALSE(q.PushNonBlocking(next));
+  for (int i = 0; i < 8; i++) {
+    EXPECT_TRUE(q.Pop(&x));
+    EXPECT_EQ(expected++, x);
+  }
+  EXPECT_FALSE(q.Pop(&x));
+
+  END;
+}
+
+// Producers push 'count_' distinct values each, alternating Push and PushMany,
+// into a ring much smaller than the total, so they keep finding it full.
+struct QueueStress {
+  LockFreeQueue<int>* queue_;
+  int count_;
+  int next_producer_;
+  Mutex mutex_;
+  vector<int>* seen_;  // Times each value was popped
+};
+
+void* Produce(void* arg) {
+  QueueStress* s = reinterpret_cast<QueueStress*>(arg);
+  s->mutex_.Lock();
+  int base = (s->next_producer_++) * s->count_;
+  s->mutex_.Unlock();
+
+  int i = 0;
+  while (i < s->count_) {
+    if (i % 2 == 0 || i + 3 > s->count_) {
+      s->queue_->Push(base + i);
+      i++;
+    } else {
+      int items[3] = {base + i, base + i + 1, base + i + 2};
+      s->queue_->PushMany(items, 3);
+      i += 3;
+    }
+  }
+  return NULL;
+}
+
+void* Consume(void* arg) {
+  QueueStress* s = reinterpret_cast<QueueStress*>(arg);
+  vector<int> popped;
+  int x;
+  while (static_cast<int>(popped.size()) < s->count_) {
+    if (s->queue_->Pop(&x))
+      popped.push_back(x);
+    else
+      sched_yield();
+  }
+  s->mutex_.Lock();
+  for (size_t i = 0; i < popped.size(); i++)
+    (*s->seen_)[popped[i]]++;
+  s->mutex_.Unlock();
+  return NULL;
+}
+
+TEST(LockFreeQueue_ParallelProducersAndConsumers) {
+  LockFreeQueue<int> q(16);
+  vector<int> seen(4 * 20000, 0);
+  QueueStress s;
+  s.queue_ = &q;
+  s.count_ = 20000;
+  s.next_producer_ = 0;
+  s.seen_ = &seen;
+
+  pthread_t threads[8];
+  for (int i = 0; i < 4; i++)
+    pthread_create(&threads[i], NULL, Produce, &s);
+  for (int i = 4; i < 8; i++)
+    pthread_create(&threads[i], NULL, Consume, &s);
+  for (int i = 0; i < 8; i++)
+    pthread_join(threads[i], NULL);
+
+  int missing = 0;
+  for (size_t i = 0; i < seen.size(); i++) {
+    if (seen[i] != 1)
+      missing++;
+  }
+  EXPECT_EQ(0, missing);
+  EXPECT_EQ(0, q.Size());
+
+  END;
+}
+
+TEST(SPSCQueue_FullAndEmpty) {
+  SPSCQueue<int> q(4);
+  int x;
+
+  EXPECT_FALSE(q.Pop(&x));
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(q.PushNonBlocking(i));
+  EXPECT_FALSE(q.PushNonBlocking(4));
+  EXPECT_EQ(4, q.Size());
+
+  // One free slot is enough to push again.
+  EXPECT_TRUE(q.Pop(&x));
+  EXPECT_EQ(0, x);
+  EXPECT_TRUE(q.PushNonBlocking(4));
+  EXPECT_FALSE(q.PushNonBlocking(5));
+
+  for (int i = 1; i < 5; i++) {
+    EXPECT_TRUE(q.Pop(&x));
+    EXPECT_EQ(i, x);
+  }
+  EXPECT_FALSE(q.Pop(&x));
+  EXPECT_EQ(0, q.Size());
+
+  END;
+}
+
+void* ProduceInOrder(void* arg) {
+  SPSCQueue<int>* q = reinterpret_cast<SPSCQueue<int>*>(arg);
+  for (int i = 0; i < 100000; i++)
+    q->Push(i);
+  return NULL;
+}
+
+TEST(SPSCQueue_Wraparound) {
+  SPSCQueue<int> q(8);
+  pthread_t producer;
+  pthread_create(&producer, NULL, ProduceInOrder, &q);
+
+  int x, expected = 0, out_of_order = 0;
+  while (expected < 100000) {
+    if (!q.Pop(&x)) {
+      sched_yield();
+      continue;
+    }
+    if (x != expected)
+      out_of_order++;
+    expected++;
+  }
+  pthread_join(producer, NULL);
+  EXPECT_EQ(0, out_of_order);
+  EXPECT_FALSE(q.Pop(&x));
+
+  END;
+}
+
+// Seconds since the epoch.
+double Now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+TEST(BlockingQueue_PopTimeout) {
+  BlockingQueue<int> q(8);
+  int x;
+
+  // An empty queue makes PopBlocking wait out its timeout, and no longer.
+  double start = Now();
+  EXPECT_FALSE(q.PopBlocking(&x, 0.05));
+  double waited = Now() - start;
+  EXPECT_TRUE(waited >= 0.04);
+  EXPECT_TRUE(waited < 1);
+  EXPECT_FALSE(q.PopBlocking(&x, 0));
+
+  // A queued element is popped without waiting.
+  q.Push(7);
+  start = Now();
+  EXPECT_TRUE(q.PopBlocking(&x, 10));
+  EXPECT_EQ(7, x);
+  EXPECT_TRUE(Now() - start < 1);
+
+  END;
+}
+
+TEST(BlockingQueue_PopManyMax) {
+  BlockingQueue<int> q(16);
+  vector<int> popped;
+  for (int i = 0; i < 10; i++)
+    q.Push(i);
+
+  // At most 'max' elements, in order, appended to what is already there.
+  EXPECT_EQ(4, q.PopMany(&popped, 4));
+  EXPECT_EQ(4, popped.size());
+  EXPECT_EQ(6, q.Size());
+  EXPECT_EQ(6, q.PopMany(&popped, 100));
+  EXPECT_EQ(10, popped.size());
+  bool in_order = true;
+  for (int i = 0; i < 10; i++)
+    in_order = in_order && popped[i] == i;
+  EXPECT_TRUE(in_order);
+
+  // A non-positive 'max' pops nothing, even from a non-empty queue.
+  q.Push(10);
+  EXPECT_EQ(0, q.PopMany(&popped, 0));
+  EXPECT_EQ(0, q.PopMany(&popped, -1));
+  EXPECT_EQ(1, q.Size());
+  EXPECT_EQ(1, q.PopMany(&popped, 1, 0));
+  EXPECT_EQ(10, popped[10]);
+
+  // An empty queue times out.
+  double start = Now();
+  EXPECT_EQ(0, q.PopMany(&popped, 5, 0.05));
+  EXPECT_TRUE(Now() - start >= 0.04);
+  EXPECT_EQ(11, popped.size());
+
+  END;
+}
+
+TEST(BlockingQueue_Overflow) {
+  BlockingQueue<int> q(4);
+  int x;
+
+  // Pushes past the ring's capacity never wait, and nothing is lost.
+  for (int i = 0; i < 10; i++)
+    q.Push(i);
+  EXPECT_TRUE(q.PushNonBlocking(10));
+  EXPECT_EQ(11, q.Size());
+
+  // Freeing ring slots does not let new elements jump the overflow list.
+  EXPECT_TRUE(q.Pop(&x));
+  EXPECT_EQ(0, x);
+  q.Push(11);
+  bool in_order = true;
+  for (int i = 1; i <= 11; i++)
+    in_order = in_order && q.Pop(&x) && x == i;
+  EXPECT_TRUE(in_order);
+  EXPECT_FALSE(q.Pop(&x));
+  EXPECT_EQ(0, q.Size());
+
+  // Once the overflow list has drained, the ring is used again.
+  q.Push(12);
+  EXPECT_TRUE(q.PopBlocking(&x, 0));
+  EXPECT_EQ(12, x);
+
+  END;
+}
+
+// Bounces a counter back and forth between two threads through two queues.
+// Every pop has to wait for the other side's push, and every other round the
+// pusher first sleeps, so the popper has gone to sleep by the time it pushes.
+struct PingPong {
+  BlockingQueue<int>* in_;
+  BlockingQueue<int>* out_;
+  int rounds_;
+  int timeouts_;
+};
+
+void* Bounce(void* arg) {
+  PingPong* p = reinterpret_cast<PingPong*>(arg);
+  int x;
+  for (int i = 0; i < p->rounds_; i++) {
+    if (!p->in_->PopBlocking(&x, 5)) {
+      p->timeouts_++;
+      return NULL;
+    }
+    if (i % 2 == 0)
+      usleep(100);
+    p->out_->Push(x + 1);
+  }
+  return NULL;
+}
+
+TEST(BlockingQueue_NoLostWakeups) {
+  BlockingQueue<int> ping(4), pong(4);
+  PingPong a = {&ping, &pong, 2000, 0};
+  PingPong b = {&pong, &ping, 2000, 0};
+
+  pthread_t threads[2];
+  pthread_create(&threads[0], NULL, Bounce, &a);
+  pthread_create(&threads[1], NULL, Bounce, &b);
+  ping.Push(0);
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+
+  // A lost wakeup would leave a popper asleep until its timeout.
+  EXPECT_EQ(0, a.timeouts_);
+  EXPECT_EQ(0, b.timeouts_);
+  int x;
+  EXPECT_TRUE(ping.Pop(&x));
+  EXPECT_EQ(4000, x);
+
+  END;
+}
+
+int main(int argc, char** argv) {
+  LockFreeQueue_FullAndEmpty();
+  LockFreeQueue_Wraparound();
+  LockFreeQueue_ParallelProducersAndConsumers();
+  SPSCQueue_FullAndEmpty();
+  SPSCQueue_Wraparound();
+  BlockingQueue_PopTimeout();
+  BlockingQueue_PopManyMax();
+  BlockingQueue_Overflow();
+  BlockingQueue_NoLostWakeups();
+}
@@ -5,6 +5,7 @@
 #include "pthread.h"
 #include "stdlib.h"
 #include "assert.h"
+#include <atomic>
 #include <queue>
 #include <string>
 #include <vector>
@@ -27,15 +28,27 @@ class StaticThreadPool : public ThreadPool {
 
 
   ~StaticThreadPool() {
-    stopped_ = true;
+    Stop();
+  }
+
+  virtual bool Active() { return !stopped_.load(); }
+
+  virtual void Stop() {
+    if (stopped_.exchange(true))
+      return;
     for (int i = 0; i < thread_count_; i++)
       pthread_join(threads_[i], NULL);
   }
 
-  bool Active() { return !stopped_; }
-
+  // Once the pool has been stopped, runs 'task' on the calling thread.
   virtual void RunTask(Task* task) {
-    assert(!stopped_);
+    if (stopped_.load()) {
+      bool owned = task->DeleteAfterRun();
+      task->Run();
+      if (owned)
+        delete task;
+      return;
+    }
     while (!queues_[rand() % thread_count_].PushNonBlocking(task)) {}
   }
 
@@ -74,8 +87,10 @@ class StaticThreadPool : public ThreadPool {
     int sleep_duration = 1;  // in microseconds
     while (true) {
       if (tp->queues_[queue_id].PopNonBlocking(&task)) {
+        bool owned = task->DeleteAfterRun();
         task->Run();
-        delete task;
+        if (owned)
+          delete task;
         // Reset backoff.
         sleep_duration = 1;
       } else {
@@ -85,11 +100,13 @@ class StaticThreadPool : public ThreadPool {
           sleep_duration *= 2;
       }
 
-      if (tp->stopped_) {
+      if (tp->stopped_.load()) {
         // Go through ALL queues looking for a remaining task.
         while (tp->queues_[queue_id].Pop(&task)) {
+            bool owned = task->DeleteAfterRun();
             task->Run();
-            delete task;
+            if (owned)
+              delete task;
         }
 
         break;
@@ -104,7 +121,7 @@ class StaticThreadPool : public ThreadPool {
   // Task queues.
   vector<AtomicQueue<Task*> > queues_;
 
-  bool stopped_;
+  std::atomic<bool> stopped_;
 };
 
 #endif  // _DB_UTILS_STATIC_THREAD_POOL_H_
@@ -118,6 +135,7 @@ class StaticThreadPool : public ThreadPool {
 #include "pthread.h"
 #include "stdlib.h"
 #include "assert.h"
+#include <atomic>
 #include <queue>
 #include <string>
 #include <vector>
@@ -140,15 +158,20 @@ class StaticThreadPool : public ThreadPool {
 
 
   ~StaticThreadPool() {
-    stopped_ = true;
+    stopped_.store(true);
     for (int i = 0; i < thread_count_; i++)
       pthread_join(threads_[i], NULL);
   }
 
-  bool Active() { return !stopped_; }
+  bool Active() { return !stopped_.load(); }
 
+  // Once the pool has been stopped, runs 'task' on the calling thread.
   virtual void RunTask(Task* task) {
-    assert(!stopped_);
+    if (stopped_.load()) {
+      task->Run();
+      delete task;
+      return;
+    }
     while (!queues_[rand() % thread_count_].PushNonBlocking(task)) {}
   }
 
@@ -198,7 +221,7 @@ class StaticThreadPool : public ThreadPool {
           sleep_duration *= 2;
       }
 
-      if (tp->stopped_) {
+      if (tp->stopped_.load()) {
         // Go through ALL queues looking for a remaining task.
         while (tp->queues_[queue_id].Pop(&task)) {
             task->Run();
@@ -217,7 +240,7 @@ class StaticThreadPool : public ThreadPool {
   // Task queues.
   vector<AtomicQueue<Task*> > queues_;
 
-  bool stopped_;
+  std::atomic<bool> stopped_;
 };
 
 #endif  // _DB_UTILS_STATIC_THREAD_POOL_H_
@@ -28,6 +28,12 @@ class Task {
 
   // Run the task.
   virtual void Run() = 0;
+
+  // Returns true if the threadpool running the task should delete it once
+  // Run() returns. Tasks embedded in (and reused by) other objects return
+  // false; the pool must then not touch the task after Run(), since its owner
+  // may already have been freed or re-dispatched.
+  virtual bool DeleteAfterRun() { return true; }
 };
 
 /// @class RTask<R>
@@ -0,0 +1,135 @@
+
+#ifndef _DB_UTILS_TASK_GROUP_H_
+#define _DB_UTILS_TASK_GROUP_H_
+
+#include <atomic>
+#include <vector>
+#include "utils/condition.h"
+#include "utils/mutex.h"
+#include "utils/task.h"
+#include "utils/thread_pool.h"
+
+using std::vector;
+
+// Number of times TaskGroup::Wait re-checks whether the tasks other threads
+// claimed have finished before it goes to sleep.
+#define TASK_GROUP_SPIN_ROUNDS 1024
+
+/// @class TaskGroup
+///
+/// Fork/join on top of a ThreadPool. Tasks added to the group are not handed
+/// to the pool one by one; instead Wait() starts up to one helper per pool
+/// thread, and the helpers and the waiting thread itself claim and run the
+/// group's tasks until none is left. The waiting thread then spins briefly,
+/// and finally sleeps, until the tasks claimed by helpers have run as well.
+///
+/// Helpers only hold on to the tasks of one Wait() call, which are freed by
+/// whichever of them finishes last, so a group can be reused or destroyed as
+/// soon as Wait() returns, even if some helpers have not even started yet.
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool* tp) : tp_(tp), pending_(new Join()) {}
+
+  ~TaskGroup() {
+    pending_->Release();
+  }
+
+  // Adds 'task' to the tasks that the next Wait() runs. The group deletes the
+  // task after running it if task->DeleteAfterRun().
+  void Add(Task* task) {
+    pending_->tasks_.push_back(task);
+  }
+
+  // Runs every task added since the last Wait(), on the pool's threads and on
+  // the calling thread, and returns once all of them have run. If the pool
+  // has been stopped, the calling thread runs all of them itself.
+  void Wait() {
+    Join* join = pending_;
+    pending_ = new Join();
+
+    int helpers = 0;
+    if (tp_->Active()) {
+      helpers = join->tasks_.size() - 1;
+      if (helpers > tp_->ThreadCount())
+        helpers = tp_->ThreadCount();
+    }
+    if (helpers > 0) {
+      join->refs_ += helpers;
+      for (int i = 0; i < helpers; i++)
+        tp_->RunTask(new Helper(join));
+    }
+
+    join->RunTasks();
+    for (int i = 0; i < TASK_GROUP_SPIN_ROUNDS && !join->Finished(); i++) {}
+    if (!join->Finished())
+      join->finished_cv_.WaitWhileFalse(&join->finished_);
+    join->Release();
+  }
+
+ private:
+  // The tasks of one Wait() call, shared by the waiting thread and the
+  // helpers.
+  struct Join {
+    Join() : next_(0), done_(0), refs_(1), finished_(false),
+             finished_cv_(&mutex_) {}
+
+    // Claims and runs tasks until none is left unclaimed.
+    void RunTasks() {
+      int count = tasks_.size();
+      int i;
+      while ((i = next_++) < count) {
+        Task* task = tasks_[i];
+        bool owned = task->DeleteAfterRun();
+        task->Run();
+        if (owned)
+          delete task;
+        if (++done_ == count) {
+          mutex_.Lock();
+          finished_ = true;
+          mutex_.Unlock();
+          finished_cv_.Signal();
+        }
+      }
+    }
+
+    // Returns true once every task has run.
+    bool Finished() {
+      return done_.load() == static_cast<int>(tasks_.size());
+    }
+
+    // Drops a reference, freeing the Join with the last one.
+    void Release() {
+      if (--refs_ == 0)
+        delete this;
+    }
+
+    vector<Task*> tasks_;
+    std::atomic<int> next_;   // Index of the next unclaimed task
+    std::atomic<int> done_;   // Number of tasks that have run
+    std::atomic<int> refs_;   // The waiting thread and unfinished helpers
+    Mutex mutex_;
+    bool finished_;           // Set with 'done_' reaching the task count
+    Condition finished_cv_;
+  };
+
+  // Pool task claiming tasks of 'join_' alongside the waiting thread.
+  class Helper : public Task {
+   public:
+    explicit Helper(Join* join) : join_(join) {}
+
+    virtual void Run() {
+      join_->RunTasks();
+      join_->Release();
+    }
+
+   private:
+    Join* join_;
+  };
+
+  ThreadPool* tp_;
+
+  // Tasks added since the last Wait().
+  Join* pending_;
+};
+
+#endif  // _DB_UTILS_TASK_GROUP_H_
@@ -0,0 +1,147 @@
+#include "utils/task_group.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "utils/testing.h"
+#include "utils/work_stealing_thread_pool.h"
+
+// Counts its runs in '*count_', and in '*on_caller_' the runs on thread
+// 'caller_'.
+class CountTask : public Task {
+ public:
+  CountTask(std::atomic<int>* count, std::atomic<int>* on_caller)
+      : count_(count), on_caller_(on_caller), caller_(pthread_self()) {}
+
+  virtual void Run() {
+    if (pthread_equal(pthread_self(), caller_))
+      (*on_caller_)++;
+    (*count_)++;
+  }
+
+ private:
+  std::atomic<int>* count_;
+  std::atomic<int>* on_caller_;
+  pthread_t caller_;
+};
+
+// Occupies a pool thread until '*release_' is set.
+class BlockTask : public Task {
+ public:
+  BlockTask(std::atomic<int>* started, std::atomic<bool>* release)
+      : started_(started), release_(release) {}
+
+  virtual void Run() {
+    (*started_)++;
+    while (!release_->load())
+      usleep(1000);
+  }
+
+ private:
+  std::atomic<int>* started_;
+  std::atomic<bool>* release_;
+};
+
+// Waits up to 'seconds' for '*count' to reach 'target'. Returns true if it did.
+bool WaitForCount(std::atomic<int>* count, int target, double seconds) {
+  for (int i = 0; i < seconds * 1000 && count->load() < target; i++)
+    usleep(1000);
+  return count->load() >= target;
+}
+
+TEST(TaskGroup_WaitRunsAllTasks) {
+  WorkStealingThreadPool pool(4);
+  std::atomic<int> count(0), on_caller(0);
+
+  // No tasks.
+  TaskGroup empty(&pool);
+  empty.Wait();
+
+  // A single task needs no helper, so the caller runs it.
+  TaskGroup one(&pool);
+  one.Add(new CountTask(&count, &on_caller));
+  one.Wait();
+  EXPECT_EQ(1, count.load());
+  EXPECT_EQ(1, on_caller.load());
+
+  // More tasks than pool threads.
+  TaskGroup many(&pool);
+  for (int i = 0; i < 1000; i++)
+    many.Add(new CountTask(&count, &on_caller));
+  many.Wait();
+  EXPECT_EQ(1001, count.load());
+
+  END;
+}
+
+TEST(TaskGroup_ReuseAfterWait) {
+  WorkStealingThreadPool pool(4);
+  std::atomic<int> count(0), on_caller(0);
+  TaskGroup group(&pool);
+
+  bool all_ran = true;
+  for (int round = 1; round <= 50; round++) {
+    for (int i = 0; i < round; i++)
+      group.Add(new CountTask(&count, &on_caller));
+    group.Wait();
+    all_ran = all_ran && count.load() == round * (round + 1) / 2;
+  }
+  EXPECT_TRUE(all_ran);
+
+  // A Wait() with nothing added since the last one runs nothing again.
+  group.Wait();
+  EXPECT_EQ(50 * 51 / 2, count.load());
+
+  END;
+}
+
+TEST(TaskGroup_DestroyWithPendingHelpers) {
+  WorkStealingThreadPool pool(4);
+  std::atomic<int> count(0), on_caller(0), started(0);
+  std::atomic<bool> release(false);
+
+  // Keep every pool thread busy, so the helpers Wait() starts stay queued
+  // and the caller runs all the tasks itself.
+  for (int i = 0; i < 4; i++)
+    pool.RunTask(new BlockTask(&started, &release));
+  EXPECT_TRUE(WaitForCount(&started, 4, 10));
+
+  TaskGroup* group = new TaskGroup(&pool);
+  for (int i = 0; i < 100; i++)
+    group->Add(new CountTask(&count, &on_caller));
+  group->Wait();
+  EXPECT_EQ(100, count.load());
+  EXPECT_EQ(100, on_caller.load());
+
+  // The helpers only start after the group is gone, and find nothing to do.
+  delete group;
+  release = true;
+  pool.Stop();
+  EXPECT_EQ(100, count.load());
+
+  END;
+}
+
+TEST(TaskGroup_WaitAfterStop) {
+  WorkStealingThreadPool pool(4);
+  std::atomic<int> count(0), on_caller(0);
+  pool.Stop();
+
+  // With the pool stopped, the caller runs every task.
+  TaskGroup group(&pool);
+  for (int i = 0; i < 100; i++)
+    group.Add(new CountTask(&count, &on_caller));
+  group.Wait();
+  EXPECT_EQ(100, count.load());
+  EXPECT_EQ(100, on_caller.load());
+
+  END;
+}
+
+int main(int argc, char** argv) {
+  TaskGroup_WaitRunsAllTasks();
+  TaskGroup_ReuseAfterWait();
+  TaskGroup_DestroyWithPendingHelpers();
+  TaskGroup_WaitAfterStop();
+}
@@ -11,11 +11,21 @@ class ThreadPool {
   virtual ~ThreadPool() {}
 
   // Causes 'task' to be scheduled for background by a thread in the threadpool.
+  // Once the threadpool has been stopped, runs 'task' on the calling thread
+  // instead. A task submitted while Stop() is running may be lost, so callers
+  // should stop submitting before they stop the pool.
   virtual void RunTask(Task* task) = 0;
 
   // Returns the number of active physical pthreads currently consituting the
   // threadpool.
   virtual int ThreadCount() = 0;
+
+  // Returns false once the threadpool has been stopped.
+  virtual bool Active() = 0;
+
+  // Stops the threadpool: Active() returns false from now on, and the call
+  // returns once the pool's threads have finished the tasks already submitted.
+  virtual void Stop() = 0;
 };
 
 #endif  // _DB_UTILS_THREAD_POOL_H_
@@ -0,0 +1,229 @@
+
+#ifndef _DB_UTILS_WORK_STEALING_THREAD_POOL_H_
+#define _DB_UTILS_WORK_STEALING_THREAD_POOL_H_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <atomic>
+#include <deque>
+#include <utility>
+#include "utils/mutex.h"
+#include "utils/thread_pool.h"
+
+using std::deque;
+using std::pair;
+
+// Number of times an idle worker re-checks for new work before parking.
+#define WORK_STEALING_SPIN_ROUNDS 1024
+
+/// @class WorkStealingThreadPool
+///
+/// Fixed-size thread pool in which every worker owns a deque of tasks. A
+/// worker takes tasks from the front of its own deque (oldest first, so that
+/// no txn lingers behind newer ones), and when its deque is empty it steals
+/// from the back of the other workers' deques. Workers that find no work
+/// anywhere spin briefly and then park on a condition variable until a new
+/// task is submitted, instead of polling with a sleep backoff.
+///
+/// Tasks submitted from one of the pool's own workers go to that worker's
+/// deque; tasks submitted from any other thread are spread round-robin.
+class WorkStealingThreadPool : public ThreadPool {
+ public:
+  explicit WorkStealingThreadPool(int nthreads)
+      : thread_count_(nthreads), next_worker_(0), pending_(0), sleepers_(0),
+        stopped_(false) {
+    pthread_mutex_init(&park_mutex_, NULL);
+    pthread_cond_init(&park_cond_, NULL);
+    Start();
+  }
+
+  ~WorkStealingThreadPool() {
+    Stop();
+    delete[] workers_;
+    pthread_cond_destroy(&park_cond_);
+    pthread_mutex_destroy(&park_mutex_);
+  }
+
+  virtual bool Active() { return !stopped_.load(); }
+
+  // Wakes all parked workers and waits for them to finish every task that has
+  // already been submitted.
+  virtual void Stop() {
+    if (stopped_.exchange(true))
+      return;
+    pthread_mutex_lock(&park_mutex_);
+    pthread_cond_broadcast(&park_cond_);
+    pthread_mutex_unlock(&park_mutex_);
+    for (int i = 0; i < thread_count_; i++)
+      pthread_join(workers_[i].thread_, NULL);
+  }
+
+  // Once the pool has been stopped, runs 'task' on the calling thread.
+  virtual void RunTask(Task* task) {
+    if (stopped_.load()) {
+      bool owned = task->DeleteAfterRun();
+      task->Run();
+      if (owned)
+        delete task;
+      return;
+    }
+
+    int id = LocalWorker();
+    if (id < 0)
+      id = next_worker_.fetch_add(1, std::memory_order_relaxed) % thread_count_;
+
+    // Count the task before it becomes visible, so that a worker that has
+    // taken it can never drive 'pending_' negative.
+    pending_.fetch_add(1);
+    workers_[id].mutex_.Lock();
+    workers_[id].tasks_.push_back(task);
+    workers_[id].mutex_.Unlock();
+
+    // A worker increments 'sleepers_' before re-checking 'pending_' under
+    // 'park_mutex_', so either it sees the task or we see it and wake it.
+    if (sleepers_.load() > 0) {
+      pthread_mutex_lock(&park_mutex_);
+      pthread_cond_signal(&park_cond_);
+      pthread_mutex_unlock(&park_mutex_);
+    }
+  }
+
+  virtual int ThreadCount() { return thread_count_; }
+
+ private:
+  struct Worker {
+    pthread_t thread_;
+    Mutex mutex_;
+    deque<Task*> tasks_;
+    // Keep neighbouring workers' deque locks off each other's cache lines.
+    char pad_[64];
+  };
+
+  void Start() {
+    workers_ = new Worker[thread_count_];
+
+    // Pin all threads in the thread pool to CPU Core 0 ~ 6
+    cpu_set_t cpuset;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    CPU_ZERO(&cpuset);
+    for (int i = 0; i < 7; i++) {
+      CPU_SET(i, &cpuset);
+    }
+
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
+
+    for (int i = 0; i < thread_count_; i++) {
+      pthread_create(&workers_[i].thread_,
+                     &attr,
+                     RunThread,
+                     reinterpret_cast<void*>(
+                         new pair<int, WorkStealingThreadPool*>(i, this)));
+    }
+  }
+
+  // Returns the index of the calling thread among this pool's workers, or -1
+  // if it is not one of them.
+  int LocalWorker() {
+    return (LocalPool() == this) ? LocalIndex() : -1;
+  }
+
+  // Pool and worker index of the calling thread, if it is a pool worker.
+  static WorkStealingThreadPool*& LocalPool() {
+    static __thread WorkStealingThreadPool* pool = NULL;
+    return pool;
+  }
+  static int& LocalIndex() {
+    static __thread int index = -1;
+    return index;
+  }
+
+  // Pops the oldest task from worker 'id''s own deque, or failing that steals
+  // the newest task from some other worker's deque.
+  bool TakeTask(int id, Task** task) {
+    for (int i = 0; i < thread_count_; i++) {
+      Worker* w = &workers_[(id + i) % thread_count_];
+      w->mutex_.Lock();
+      if (!w->tasks_.empty()) {
+        if (i == 0) {
+          *task = w->tasks_.front();
+          w->tasks_.pop_front();
+        } else {
+          *task = w->tasks_.back();
+          w->tasks_.pop_back();
+        }
+        w->mutex_.Unlock();
+        pending_.fetch_sub(1);
+        return true;
+      }
+      w->mutex_.Unlock();
+    }
+    return false;
+  }
+
+  // Blocks until some task may be available or the pool is stopped.
+  void Park() {
+    for (int i = 0; i < WORK_STEALING_SPIN_ROUNDS; i++) {
+      if (pending_.load(std::memory_order_relaxed) > 0 || stopped_.load())
+        return;
+    }
+
+    pthread_mutex_lock(&park_mutex_);
+    sleepers_.fetch_add(1);
+    while (pending_.load() == 0 && !stopped_.load())
+      pthread_cond_wait(&park_cond_, &park_mutex_);
+    sleepers_.fetch_sub(1);
+    pthread_mutex_unlock(&park_mutex_);
+  }
+
+  // Function executed by each pthread.
+  static void* RunThread(void* arg) {
+    int id = reinterpret_cast<pair<int, WorkStealingThreadPool*>*>(arg)->first;
+    WorkStealingThreadPool* tp =
+        reinterpret_cast<pair<int, WorkStealingThreadPool*>*>(arg)->second;
+    delete reinterpret_cast<pair<int, WorkStealingThreadPool*>*>(arg);
+
+    LocalPool() = tp;
+    LocalIndex() = id;
+
+    Task* task;
+    while (true) {
+      if (tp->TakeTask(id, &task)) {
+        bool owned = task->DeleteAfterRun();
+        task->Run();
+        if (owned)
+          delete task;
+        continue;
+      }
+
+      // Only exit once every submitted task has been taken by some worker.
+      if (tp->stopped_.load() && tp->pending_.load() == 0)
+        break;
+
+      tp->Park();
+    }
+
+    LocalPool() = NULL;
+    return NULL;
+  }
+
+  int thread_count_;
+  Worker* workers_;
+
+  // Round-robin cursor for tasks submitted by threads outside the pool.
+  std::atomic<unsigned int> next_worker_;
+
+  // Number of tasks submitted but not yet taken by a worker.
+  std::atomic<int> pending_;
+
+  // Number of workers parked (or about to park) on 'park_cond_'.
+  std::atomic<int> sleepers_;
+
+  pthread_mutex_t park_mutex_;
+  pthread_cond_t park_cond_;
+
+  std::atomic<bool> stopped_;
+};
+
+#endif  // _DB_UTILS_WORK_STEALING_THREAD_POOL_H_
@@ -0,0 +1,150 @@
+#include "utils/work_stealing_thread_pool.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "utils/static_thread_pool.h"
+#include "utils/testing.h"
+
+// Counts its runs in '*count_', and first submits 'children_' more tasks
+// like itself (without children) to 'pool_' if that is non-NULL.
+class CountTask : public Task {
+ public:
+  CountTask(std::atomic<int>* count, ThreadPool* pool = NULL, int children = 0)
+      : count_(count), pool_(pool), children_(children) {}
+
+  virtual void Run() {
+    for (int i = 0; i < children_; i++)
+      pool_->RunTask(new CountTask(count_));
+    (*count_)++;
+  }
+
+ private:
+  std::atomic<int>* count_;
+  ThreadPool* pool_;
+  int children_;
+};
+
+// Waits up to 'seconds' for '*count' to reach 'target'. Returns true if it did.
+bool WaitForCount(std::atomic<int>* count, int target, double seconds) {
+  for (int i = 0; i < seconds * 1000 && count->load() < target; i++)
+    usleep(1000);
+  return count->load() >= target;
+}
+
+// Seconds of CPU time that this process has used so far.
+double CpuTime() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+TEST(WorkStealingThreadPool_RunsAllTasks) {
+  WorkStealingThreadPool pool(4);
+  std::atomic<int> count(0);
+
+  for (int i = 0; i < 10000; i++)
+    pool.RunTask(new CountTask(&count));
+  EXPECT_TRUE(WaitForCount(&count, 10000, 10));
+  EXPECT_EQ(10000, count.load());
+
+  END;
+}
+
+TEST(WorkStealingThreadPool_WorkersSubmitAndSteal) {
+  WorkStealingThreadPool pool(4);
+  std::atomic<int> count(0);
+
+  // Each parent queues its 100 children on its own worker's deque, so the
+  // other workers only get them by stealing.
+  for (int i = 0; i < 10; i++)
+    pool.RunTask(new CountTask(&count, &pool, 100));
+  EXPECT_TRUE(WaitForCount(&count, 10 * 101, 10));
+  EXPECT_EQ(10 * 101, count.load());
+
+  END;
+}
+
+TEST(WorkStealingThreadPool_ParkedWorkersStayIdle) {
+  WorkStealingThreadPool pool(4);
+
+  // Let the workers run out of spin rounds and park.
+  usleep(50000);
+  double start = CpuTime();
+  usleep(200000);
+  double used = CpuTime() - start;
+  EXPECT_TRUE(used < 0.05);
+
+  END;
+}
+
+TEST(WorkStealingThreadPool_WakesParkedWorkers) {
+  WorkStealingThreadPool pool(4);
+  std::atomic<int> count(0);
+
+  // Alternate between submitting to parked workers and to workers that are
+  // still spinning or just parking, so both sides of the wakeup race run.
+  int woken = 0;
+  for (int i = 0; i < 200; i++) {
+    usleep(i % 2 == 0 ? 5000 : 0);
+    pool.RunTask(new CountTask(&count));
+    if (WaitForCount(&count, i + 1, 5))
+      woken++;
+  }
+  EXPECT_EQ(200, woken);
+
+  END;
+}
+
+TEST(WorkStealingThreadPool_StopRunsSubmittedTasks) {
+  WorkStealingThreadPool pool(4);
+  std::atomic<int> count(0);
+
+  EXPECT_TRUE(pool.Active());
+  for (int i = 0; i < 1000; i++)
+    pool.RunTask(new CountTask(&count));
+  pool.Stop();
+  EXPECT_FALSE(pool.Active());
+  EXPECT_EQ(1000, count.load());
+
+  // A second Stop() is a no-op.
+  pool.Stop();
+
+  END;
+}
+
+// Submits 100 tasks to 'pool' after stopping it, and returns how many ran
+// before RunTask returned.
+int RunTasksAfterStop(ThreadPool* pool) {
+  std::atomic<int> count(0);
+  pool->Stop();
+  int ran = 0;
+  for (int i = 0; i < 100; i++) {
+    pool->RunTask(new CountTask(&count));
+    if (count.load() == i + 1)
+      ran++;
+  }
+  return ran;
+}
+
+TEST(ThreadPools_RunTaskAfterStop) {
+  // A stopped pool runs new tasks on the calling thread, rather than losing
+  // them (or asserting).
+  WorkStealingThreadPool work_stealing(4);
+  EXPECT_EQ(100, RunTasksAfterStop(&work_stealing));
+  StaticThreadPool static_pool(4);
+  EXPECT_EQ(100, RunTasksAfterStop(&static_pool));
+
+  END;
+}
+
+int main(int argc, char** argv) {
+  WorkStealingThreadPool_RunsAllTasks();
+  WorkStealingThreadPool_WorkersSubmitAndSteal();
+  WorkStealingThreadPool_ParkedWorkersStayIdle();
+  WorkStealingThreadPool_WakesParkedWorkers();
+  WorkStealingThreadPool_StopRunsSubmittedTasks();
+  ThreadPools_RunTaskAfterStop();
+}